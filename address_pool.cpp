@@ -0,0 +1,293 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "address_pool.h"
+#include "flat_map.h"
+#include "lease_cache.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+#include <mutex>
+
+namespace
+{
+	const size_t npos = size_t( -1 );
+
+	// Dynamic addresses further apart than this go in separate pools
+	const uint32_t pool_gap = 256;
+
+	std::mutex pool_mutex;
+	std::vector<address_pool> pools;
+
+	// Find the pool holding the address (with the pools locked).
+	address_pool *findPool( uint32_t ip )
+	{
+		auto p = std::upper_bound( pools.begin(), pools.end(), ip,
+			[]( uint32_t i, const address_pool &pool ) { return i < pool.first(); } );
+		if ( p == pools.begin() )
+			return NULL;
+		--p;
+		return p->contains( ip ) ? &*p : NULL;
+	}
+}
+
+////////////////////////////////////////
+
+std::vector<address_range> mergeRanges( std::vector<address_range> ranges )
+{
+	std::sort( ranges.begin(), ranges.end(),
+		[]( const address_range &a, const address_range &b ) { return a.first < b.first; } );
+
+	std::vector<address_range> ret;
+	for ( const address_range &r: ranges )
+	{
+		if ( !ret.empty() && uint64_t( r.first ) <= uint64_t( ret.back().last ) + 1 )
+			ret.back().last = std::max( ret.back().last, r.last );
+		else
+			ret.push_back( r );
+	}
+	return ret;
+}
+
+////////////////////////////////////////
+
+std::vector<address_range> subtractRanges( const std::vector<address_range> &ranges, const std::vector<address_range> &holes )
+{
+	std::vector<address_range> ret;
+	size_t h = 0;
+	for ( address_range r: ranges )
+	{
+		while ( h < holes.size() && holes[h].last < r.first )
+			++h;
+
+		for ( size_t k = h; k < holes.size() && holes[k].first <= r.last; ++k )
+		{
+			if ( holes[k].first > r.first )
+				ret.push_back( { r.first, holes[k].first - 1 } );
+			if ( holes[k].last >= r.last )
+			{
+				r.first = 1;
+				r.last = 0;
+				break;
+			}
+			r.first = holes[k].last + 1;
+		}
+
+		if ( r.first <= r.last )
+			ret.push_back( r );
+	}
+	return ret;
+}
+
+////////////////////////////////////////
+
+address_pool::address_pool( uint32_t first, uint32_t last )
+	: _first( first ), _size( size_t( last - first ) + 1 ),
+	  _leases( _size, slot { 0, 0 } ),
+	  _dynamic( ( _size + 63 ) / 64, 0 ),
+	  _free( ( _size + 63 ) / 64, 0 ),
+	  _summary( ( _free.size() + 63 ) / 64, 0 )
+{
+}
+
+////////////////////////////////////////
+
+void address_pool::setFree( size_t i, bool free )
+{
+	size_t w = i / 64;
+	if ( free )
+		_free[w] |= uint64_t( 1 ) << ( i % 64 );
+	else
+		_free[w] &= ~( uint64_t( 1 ) << ( i % 64 ) );
+
+	if ( _free[w] )
+		_summary[w / 64] |= uint64_t( 1 ) << ( w % 64 );
+	else
+		_summary[w / 64] &= ~( uint64_t( 1 ) << ( w % 64 ) );
+}
+
+////////////////////////////////////////
+
+size_t address_pool::nextWord( size_t w ) const
+{
+	for ( size_t s = w / 64; s < _summary.size(); ++s )
+	{
+		uint64_t bits = _summary[s];
+		if ( s == w / 64 )
+			bits &= ~uint64_t( 0 ) << ( w % 64 );
+		if ( bits )
+			return s * 64 + __builtin_ctzll( bits );
+	}
+	return npos;
+}
+
+////////////////////////////////////////
+
+void address_pool::addDynamic( const address_range &r )
+{
+	for ( size_t i = r.first - _first; i <= r.last - _first; ++i )
+	{
+		_dynamic[i / 64] |= uint64_t( 1 ) << ( i % 64 );
+		setFree( i, _leases[i].expires == 0 );
+	}
+}
+
+////////////////////////////////////////
+
+void address_pool::lease( uint32_t ip, uint64_t mac, time_t expires )
+{
+	size_t i = ip - _first;
+	_leases[i].mac = mac;
+	_leases[i].expires = expires;
+	setFree( i, false );
+}
+
+////////////////////////////////////////
+
+void address_pool::release( uint32_t ip )
+{
+	size_t i = ip - _first;
+	_leases[i].mac = 0;
+	_leases[i].expires = 0;
+	setFree( i, isDynamic( i ) );
+}
+
+////////////////////////////////////////
+
+bool address_pool::available( uint32_t ip, uint64_t mac, time_t now ) const
+{
+	size_t i = ip - _first;
+	if ( !isDynamic( i ) )
+		return false;
+	const slot &s = _leases[i];
+	return s.expires <= now || s.mac == mac;
+}
+
+////////////////////////////////////////
+
+size_t address_pool::find( std::vector<uint32_t> &ips, size_t max, uint64_t start )
+{
+	// Search from the start address to the end, then from the beginning
+	size_t from = start % _size;
+	size_t n = 0;
+	for ( int pass = 0; pass < 2 && n < max; ++pass )
+	{
+		size_t begin = pass == 0 ? from : 0;
+		size_t end = pass == 0 ? _size : from;
+		for ( size_t w = nextWord( begin / 64 ); w != npos && w * 64 < end && n < max; w = nextWord( w + 1 ) )
+		{
+			uint64_t bits = _free[w];
+			if ( w == begin / 64 )
+				bits &= ~uint64_t( 0 ) << ( begin % 64 );
+			for ( ; bits && n < max; bits &= bits - 1 )
+			{
+				size_t i = w * 64 + __builtin_ctzll( bits );
+				if ( i >= end )
+					break;
+				ips.push_back( htonl( _first + uint32_t( i ) ) );
+				++n;
+			}
+		}
+	}
+	return n;
+}
+
+////////////////////////////////////////
+
+void buildPools( const std::vector<address_range> &ranges )
+{
+	std::vector<address_pool> built;
+	for ( size_t i = 0; i < ranges.size(); )
+	{
+		size_t j = i + 1;
+		while ( j < ranges.size() && ranges[j].first - ranges[j - 1].last <= pool_gap )
+			++j;
+
+		address_pool pool( ranges[i].first, ranges[j - 1].last );
+		for ( size_t k = i; k < j; ++k )
+			pool.addDynamic( ranges[k] );
+		built.push_back( std::move( pool ) );
+		i = j;
+	}
+
+	{
+		std::unique_lock<std::mutex> lock( pool_mutex );
+		pools.swap( built );
+	}
+
+	forEachLease( poolLease );
+}
+
+////////////////////////////////////////
+
+void poolLease( uint32_t ip, const uint8_t *mac, time_t expires )
+{
+	std::unique_lock<std::mutex> lock( pool_mutex );
+	if ( address_pool *p = findPool( ntohl( ip ) ) )
+		p->lease( ntohl( ip ), pack_mac( mac ), expires );
+}
+
+////////////////////////////////////////
+
+void poolRelease( uint32_t ip )
+{
+	std::unique_lock<std::mutex> lock( pool_mutex );
+	if ( address_pool *p = findPool( ntohl( ip ) ) )
+		p->release( ntohl( ip ) );
+}
+
+////////////////////////////////////////
+
+bool poolAvailable( uint32_t ip, const uint8_t *mac )
+{
+	std::unique_lock<std::mutex> lock( pool_mutex );
+	address_pool *p = findPool( ntohl( ip ) );
+	return p && p->available( ntohl( ip ), pack_mac( mac ), time( NULL ) );
+}
+
+////////////////////////////////////////
+
+uint64_t macHash( const uint8_t *mac )
+{
+	uint64_t h = pack_mac( mac ) * 0x9E3779B97F4A7C15ull;
+	return h ^ ( h >> 31 );
+}
+
+////////////////////////////////////////
+
+void freeAddresses( std::vector<uint32_t> &ips, size_t max, const uint8_t *mac )
+{
+	uint64_t h = macHash( mac );
+
+	std::unique_lock<std::mutex> lock( pool_mutex );
+	if ( pools.empty() )
+		return;
+
+	size_t first = h % pools.size();
+	size_t found = 0;
+	for ( size_t k = 0; k < pools.size() && found < max; ++k )
+		found += pools[( first + k ) % pools.size()].find( ips, max - found, h );
+}
+
+////////////////////////////////////////
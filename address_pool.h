@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+////////////////////////////////////////
+
+// An inclusive range of addresses (host order).
+struct address_range
+{
+	uint32_t first;
+	uint32_t last;
+};
+
+// Sort the ranges and merge the ones that overlap or touch.
+std::vector<address_range> mergeRanges( std::vector<address_range> ranges );
+
+// The parts of the (merged) ranges that are not in the (merged) holes.
+std::vector<address_range> subtractRanges( const std::vector<address_range> &ranges, const std::vector<address_range> &holes );
+
+////////////////////////////////////////
+
+// A range of addresses with a lease slot for each, and a two level
+// bitmap of the dynamic addresses that are free: one bit per address,
+// and one summary bit per 64 addresses.  Addresses are in host order.
+class address_pool
+{
+public:
+	address_pool( uint32_t first, uint32_t last );
+
+	uint32_t first( void ) const
+	{
+		return _first;
+	}
+
+	bool contains( uint32_t ip ) const
+	{
+		return ip >= _first && ip - _first < _size;
+	}
+
+	// Allow the addresses to be given to any client.
+	void addDynamic( const address_range &r );
+
+	// Record a lease on the address, or its release.
+	void lease( uint32_t ip, uint64_t mac, time_t expires );
+	void release( uint32_t ip );
+
+	// Check if the dynamic address can be given to the client.
+	bool available( uint32_t ip, uint64_t mac, time_t now ) const;
+
+	// Append up to max free addresses (network order), searching from the
+	// given point in the pool and wrapping around.
+	size_t find( std::vector<uint32_t> &ips, size_t max, uint64_t start );
+
+private:
+	struct slot
+	{
+		uint64_t mac;
+		time_t expires;
+	};
+
+	bool isDynamic( size_t i ) const
+	{
+		return ( _dynamic[i / 64] >> ( i % 64 ) ) & 1;
+	}
+
+	void setFree( size_t i, bool free );
+	size_t nextWord( size_t w ) const;
+
+	uint32_t _first;
+	size_t _size;
+	std::vector<slot> _leases;
+	std::vector<uint64_t> _dynamic;
+	std::vector<uint64_t> _free;
+	std::vector<uint64_t> _summary;
+};
+
+////////////////////////////////////////
+
+// Build the pools for the dynamic address ranges (merged), and load the
+// leases known to the lease cache into them.
+void buildPools( const std::vector<address_range> &dynamic );
+
+// Record a lease (or its release) in the pool holding the address.  The
+// lease cache releases the addresses of expired leases (each second, from
+// the sweeper), so the pools are never scanned for them.
+void poolLease( uint32_t ip, const uint8_t *mac, time_t expires );
+void poolRelease( uint32_t ip );
+
+// Check if the address is a dynamic address the client can have.
+bool poolAvailable( uint32_t ip, const uint8_t *mac );
+
+// Append up to max free dynamic addresses (network order) for the client.
+// Each client starts searching at a point given by a hash of its MAC, so
+// clients asking at the same time are spread over the pools.
+void freeAddresses( std::vector<uint32_t> &ips, size_t max, const uint8_t *mac );
+
+// Hash a MAC address to pick a starting point for the search.
+uint64_t macHash( const uint8_t *mac );
+
+////////////////////////////////////////
+
@@ -1,5 +1,5 @@
 //
-// Copyright (c) 2012 Ian Godin
+// Copyright (c) 2013 Ian Godin
 //
 // Permission is hereby granted, free of charge, to any person obtaining
 // a copy of this software and associated documentation files (the "Software"),
@@ -20,417 +20,215 @@
 // OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 //
 
-#include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include <syslog.h>
-#include <pthread.h>
-#include <arpa/inet.h>
-#include <mysql/mysql.h>
 
-#include <mutex>
-#include <map>
-#include <thread>
 
 #include "backend.h"
 #include "error.h"
-#include "format.h"
-#include "guard.h"
+#include "memory_backend.h"
+#include "mysql_backend.h"
+#include "native_backend.h"
+#ifdef HAVE_SQLITE
+#include "sqlite_backend.h"
+#endif
+
+#include <mutex>
 
 namespace
 {
-	std::mutex db_mutex;
-	std::map<std::thread::id,MYSQL*> dbs;
+	backend *createBackend( void )
+	{
+		std::string name = configuration["backend"];
+		if ( name.empty() || name == "mysql" )
+			return new mysql_backend;
+		if ( name == "memory" )
+			return new memory_backend;
+		if ( name == "native" )
+			return new native_backend;
+#ifdef HAVE_SQLITE
+		if ( name == "sqlite" )
+			return new sqlite_backend;
+#endif
+		error( "Unknown backend '" + name + "'" );
+		return NULL;
+	}
 }
 
 ////////////////////////////////////////
 
-void threadStartBackend( void )
+backend::~backend( void )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-
-	std::string dbhost = configuration["dbhost"];
-	std::string database = configuration["database"];
-	std::string dbuser = configuration["dbuser"];
-	std::string dbpassword = configuration["dbpassword"];
-
-	if ( dbhost.empty() || database.empty() || dbuser.empty() || dbpassword.empty() )
-		error( "Invalid configuration of database" );
+}
 
-	mysql_thread_init();
-	MYSQL *db = mysql_init( NULL );
-	if ( db == NULL )
-		error( "Unable to init library" );
+////////////////////////////////////////
 
-	my_bool reconnect = 1;
-	unsigned int protocol = MYSQL_PROTOCOL_TCP;
-	mysql_options( db, MYSQL_OPT_RECONNECT, &reconnect );
-	mysql_options( db, MYSQL_OPT_PROTOCOL, (const char *)&protocol );
+backend &currentBackend( void )
+{
+	static std::once_flag created;
+	static backend *current = NULL;
+	std::call_once( created, []() { current = createBackend(); } );
+	return *current;
+}
 
-	if ( mysql_real_connect( db, dbhost.c_str(), dbuser.c_str(), dbpassword.c_str(), database.c_str(), 0, NULL, CLIENT_MULTI_STATEMENTS ) == NULL )
-		error( std::string( "Unable to open mysql: " ) + mysql_error( db ) );
+////////////////////////////////////////
 
-	dbs[std::this_thread::get_id()] = db;
+void threadStartBackend( void )
+{
+	currentBackend().threadStart();
 }
 
 ////////////////////////////////////////
 
 void threadStopBackend( void )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	dbs.erase( std::this_thread::get_id() );
-	lock.unlock();
-
-	mysql_close( db );
-	mysql_thread_end();
+	currentBackend().threadStop();
 }
 
 ////////////////////////////////////////
 
-void getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &hosts )
+void startLeaseJournal( void )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query( "SELECT ip_addr, mac_addr, DATE_FORMAT( expiration, '%Y-%m-%dT%T') as expire FROM dhcp_lease ORDER BY ip_addr" );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
-
-	MYSQL_RES *result = mysql_store_result( db );
-	auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
-
-	if ( result == NULL )
-		error( std::string( "Error storing result from mysql: " ) + mysql_error( db ) );
-
-	MYSQL_ROW row;
-	while ( ( row = mysql_fetch_row( result ) ) )
-	{
-		unsigned long *lengths = mysql_fetch_lengths( result );
-		hosts.emplace_back(
-			htonl( std::stoul( std::string( row[0], lengths[0] ) ) ),
-			std::string( row[1], lengths[1] ),
-			std::string( row[2], lengths[2] )
-		);
-	}
+	currentBackend().startLeaseJournal();
 }
 
 ////////////////////////////////////////
 
-void getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts )
+void startSnapshot( void )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query( "SELECT ip_addr, mac_addr FROM dhcp_host ORDER BY ip_addr" );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
-
-	MYSQL_RES *result = mysql_store_result( db );
-	auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
-
-	if ( result == NULL )
-		error( std::string( "Error storing result from mysql: " ) + mysql_error( db ) );
-
-	MYSQL_ROW row;
-	while ( ( row = mysql_fetch_row( result ) ) )
-	{
-		unsigned long *lengths = mysql_fetch_lengths( result );
-		hosts.emplace_back(
-			htonl( std::stoul( std::string( row[0], lengths[0] ) ) ),
-			std::string( row[1], lengths[1] ) );
-	}
+	currentBackend().startSnapshot();
 }
 
 ////////////////////////////////////////
 
-void getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options )
+void startLeaseSweeper( void )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query( "SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options ORDER BY ip_addr_from, ip_addr_to, options" );
+	currentBackend().startLeaseSweeper();
+}
 
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+////////////////////////////////////////
 
-	MYSQL_RES *result = mysql_store_result( db );
-	auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
+int schemaVersion( void )
+{
+	return currentBackend().schemaVersion();
+}
 
-	if ( result == NULL )
-		error( std::string( "Error storing result from mysql: " ) + mysql_error( db ) );
+////////////////////////////////////////
 
-	MYSQL_ROW row;
-	while ( ( row = mysql_fetch_row( result ) ) )
-	{
-		unsigned long *lengths = mysql_fetch_lengths( result );
-		options.emplace_back(
-			htonl( std::stoul( std::string( row[0], lengths[0] ) ) ),
-			htonl( std::stoul( std::string( row[1], lengths[1] ) ) ),
-			std::string( row[2], lengths[2] ) );
-	}
+void migrateSchema( void )
+{
+	currentBackend().migrateSchema();
 }
 
 ////////////////////////////////////////
 
-std::vector<uint32_t> getIPAddresses( const uint8_t *hwaddr, bool avail )
+void getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query;
-	if ( avail )
-	{
-		query = format (
-			"SELECT ip_addr FROM dhcp_host "
-				"WHERE ( mac_addr=x'{0,B16,f0,w2}' OR mac_addr=x'000000000000' ) "
-				"AND ip_addr NOT IN ( SELECT ip_addr FROM dhcp_lease WHERE mac_addr <> x'{0,B16,f0,w2}' AND expiration > NOW() ) "
-				"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC",
-			as_hex<uint8_t>( hwaddr, 6 ) );
-	}
-	else
-	{
-		query = format (
-			"SELECT ip_addr FROM dhcp_host "
-				"WHERE mac_addr=x'{0,B16,f0,w2}' OR mac_addr=x'000000000000' "
-				"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC",
-			as_hex<uint8_t>( hwaddr, 6 ) );
-	}
+	currentBackend().getAllLeases( leases );
+}
 
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( format( "Error querying mysql: {0}", mysql_error( db ) ) );
+////////////////////////////////////////
 
-	MYSQL_RES *result = mysql_store_result( db );
-	auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
+void getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts )
+{
+	currentBackend().getAllHosts( hosts );
+}
 
-	if ( result == NULL )
-		error( format( "Error storing result from mysql: {0}", mysql_error( db ) ) );
+////////////////////////////////////////
 
-	std::vector<uint32_t> ret;
+void getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options )
+{
+	currentBackend().getAllOptions( options );
+}
 
-	MYSQL_ROW row;
-	while ( ( row = mysql_fetch_row( result ) ) )
-	{
-		if ( row != NULL && row[0] )
-			ret.push_back( htonl( atoi( row[0] ) ) );
-	}
+////////////////////////////////////////
 
-	return ret;
+std::vector<uint32_t> getIPAddresses( const uint8_t *mac, bool avail )
+{
+	return currentBackend().getIPAddresses( mac, avail );
 }
 
 ////////////////////////////////////////
 
 std::vector<std::string> getMACAddresses( uint32_t ip )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query;
-	query = format (
-		"SELECT mac_addr FROM dhcp_host "
-			"WHERE ip_addr={0} "
-			"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC",
-		ntohl( ip ) );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( format( "Error querying mysql: {0}", mysql_error( db ) ) );
-
-	MYSQL_RES *result = mysql_store_result( db );
-	auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
-
-	if ( result == NULL )
-		error( format( "Error storing result from mysql: {0}", mysql_error( db ) ) );
-
-	std::vector<std::string> ret;
+	return currentBackend().getMACAddresses( ip );
+}
 
-	MYSQL_ROW row;
-	while ( ( row = mysql_fetch_row( result ) ) )
-	{
-		unsigned long *lengths = mysql_fetch_lengths( result );
-		if ( row != NULL && row[0] )
-			ret.emplace_back( row[0], lengths[0] );
-	}
+////////////////////////////////////////
 
-	return ret;
+bool addressAvailable( uint32_t ip, const uint8_t *mac )
+{
+	return currentBackend().addressAvailable( ip, mac );
 }
 
 ////////////////////////////////////////
 
 void getOptions( uint32_t ip, std::vector<std::string> &options )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query = format( "SELECT options FROM dhcp_options WHERE ( {0} >= ip_addr_from AND {0} <= ip_addr_to )", ntohl( ip ) );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
-
-	MYSQL_RES *result = mysql_store_result( db );
-	auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
-
-	if ( result == NULL )
-		error( std::string( "Error storing result from mysql: " ) + mysql_error( db ) );
-
-	MYSQL_ROW row;
-	while ( ( row = mysql_fetch_row( result ) ) )
-	{
-		unsigned long *lengths = mysql_fetch_lengths( result );
-		options.push_back( std::string( row[0], lengths[0] ) );
-	}
+	currentBackend().getOptions( ip, options );
 }
 
 ////////////////////////////////////////
 
 void addHost( uint32_t ip, const uint8_t *mac )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query = format(
-		"INSERT INTO dhcp_host ( ip_addr, mac_addr )"
-			"VALUES( {0}, x'{1,B16,f0,w2}' )",
-		ntohl( ip ), as_hex<uint8_t>( mac, 6 ) );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+	currentBackend().addHost( ip, mac );
 }
 
 ////////////////////////////////////////
 
 void removeHost( uint32_t ip )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query = format( "DELETE FROM dhcp_host WHERE ip_addr = {0}", ntohl( ip ) );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+	currentBackend().removeHost( ip );
 }
 
 ////////////////////////////////////////
 
-void addOption( uint32_t ip1, uint32_t ip2, const std::string &opt, bool replace )
+void addOption( uint32_t ip1, uint32_t ip2, const std::string &option, bool replace )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query;
-	if ( replace )
-	{
-		query = format( "UPDATE dhcp_options "
-			"SET options=x'{2,B16,f0,w2}' WHERE ( ip_addr_from = {0} AND ip_addr_to = {1} AND options LIKE x'{3,B16,f0,w2}25' )",
-			ntohl( ip1 ), ntohl( ip2 ), as_hex<char>( opt ), uint32_t( uint8_t( opt[0] ) ) );
-	}
-	else
-	{
-		query = format( "INSERT INTO dhcp_options ( ip_addr_from, ip_addr_to, options )"
-			"VALUES( {0}, {1}, x'{2,B16,f0,w2}' )",
-			ntohl( ip1 ), ntohl( ip2 ), as_hex<char>( opt ) );
-	}
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
-
+	currentBackend().addOption( ip1, ip2, option, replace );
 }
 
 ////////////////////////////////////////
 
-void removeOption( uint32_t ip1, uint32_t ip2, const std::string &opt )
+void removeOption( uint32_t ip1, uint32_t ip2, const std::string &option )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query = format( "DELETE FROM dhcp_options WHERE ip_addr_from={0} AND ip_addr_to={1} AND options=x'{2,B16,f0,w2}'",
-		ntohl( ip1 ), ntohl( ip2 ), as_hex<char>( opt ) );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+	currentBackend().removeOption( ip1, ip2, option );
 }
 
 ////////////////////////////////////////
 
-bool acquireLease( uint32_t ip, const uint8_t *hwaddr, uint32_t time )
+void getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query = format(
-		"INSERT IGNORE INTO dhcp_lease ( ip_addr, mac_addr, expiration ) "
-			"VALUES( {0}, x'{1,B16,f0,w2}', 0 )",
-		ntohl( ip ), as_hex<uint8_t>( hwaddr, 6 ), time );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-	{
-		syslog( LOG_ERR, "Acquire lease: %s", mysql_error( db ) );
-		return false;
-	}
-
-	query = format( "UPDATE dhcp_lease "
-			"SET expiration=TIMESTAMPADD( SECOND, {2}, NOW() ), mac_addr=x'{1,B16,f0,w2}' "
-			"WHERE ip_addr = {0} AND ( mac_addr = x'{1,B16,f0,w2}' OR expiration <= NOW() )",
-		ntohl( ip ), as_hex<uint8_t>( hwaddr, 6 ), time );
-
-	if ( mysql_query( db, query.c_str() ) != 0 )
-	{
-		syslog( LOG_ERR, "Lease expiration: %s", mysql_error( db ) );
-		return false;
-	}
+	currentBackend().getAllPools( pools, exclusions );
+}
 
-	int affected = mysql_affected_rows( db );
-   	if ( affected != 1 )
-	{
-		syslog( LOG_DEBUG, "%s", query.c_str() );
-		syslog( LOG_ERR, "Lease expiration (%d): ip is already assigned", affected );
-		return false;
-	}
+////////////////////////////////////////
 
-	syslog( LOG_ERR, "Acquired lease: %u", time );
-	return true;
+void addPool( uint32_t ip1, uint32_t ip2, bool exclusion )
+{
+	currentBackend().addPool( ip1, ip2, exclusion );
 }
 
 ////////////////////////////////////////
 
-bool releaseLease( uint32_t ip, const uint8_t *hwaddr )
+void removePool( uint32_t ip1, uint32_t ip2, bool exclusion )
 {
-	std::unique_lock<std::mutex> lock( db_mutex );
-	MYSQL *db = dbs[std::this_thread::get_id()];
-	lock.unlock();
-
-	std::string query;
+	currentBackend().removePool( ip1, ip2, exclusion );
+}
 
-	if ( hwaddr )
-	{
-		query = format( "DELETE FROM dhcp_lease "
-			"WHERE ip_addr = {0} AND mac_addr = x'{1,B16,f0,w2}'",
-		ntohl( ip ), as_hex<uint8_t>( hwaddr, 6 ) );
-	}
-	else
-		query = format( "DELETE FROM dhcp_lease " "WHERE ip_addr = {0}", ntohl( ip ) );
+////////////////////////////////////////
 
-	if ( mysql_query( db, query.c_str() ) != 0 )
-		return false;
+bool acquireLease( uint32_t ip, const uint8_t *mac, uint32_t time )
+{
+	return currentBackend().acquireLease( ip, mac, time );
+}
 
-	if ( mysql_affected_rows( db ) < 1 )
-		return false;
+////////////////////////////////////////
 
-	return true;
+bool releaseLease( uint32_t ip, const uint8_t *mac )
+{
+	return currentBackend().releaseLease( ip, mac );
 }
 
-
 ////////////////////////////////////////
 
@@ -31,10 +31,38 @@
 
 ////////////////////////////////////////
 
+// The functions below pass each call on to the backend chosen by the
+// "backend" setting: mysql (the default), memory, native, or sqlite (when
+// built with SQLite).
+
 // Called once for each thread.
 void threadStartBackend( void );
 void threadStopBackend( void );
 
+// Open the lease journal (if configured) and start flushing it.
+// Called once by the server.
+void startLeaseJournal( void );
+
+// Load the hosts, options and leases into memory and keep them current
+// from the change log (if enabled), along with the filter of unknown
+// clients.  Called once by the server.
+void startSnapshot( void );
+
+// Expire the leases and offers held in memory, and delete the rows of
+// expired leases in the background.  Called once by the server.
+void startLeaseSweeper( void );
+
+////////////////////////////////////////
+
+// The schema version the server needs.
+const int schema_version = 5;
+
+// Get the version of the database schema (1 for the original tables).
+int schemaVersion( void );
+
+// Upgrade the database schema to the current version.
+void migrateSchema( void );
+
 ////////////////////////////////////////
 
 void getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases );
@@ -47,6 +75,9 @@ void getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &
 std::vector<uint32_t> getIPAddresses( const uint8_t *mac, bool avail = false );
 std::vector<std::string> getMACAddresses( uint32_t ip );
 
+// Check if the IP address can be given to the MAC address.
+bool addressAvailable( uint32_t ip, const uint8_t *mac );
+
 // Get the DHCP options for the given IP.
 void getOptions( uint32_t ip, std::vector<std::string> &options );
 
@@ -58,6 +89,11 @@ void removeHost( uint32_t ip );
 void addOption( uint32_t ip1, uint32_t ip2, const std::string &option, bool replace );
 void removeOption( uint32_t ip1, uint32_t ip2, const std::string &option );
 
+// Dynamic address pools, and ranges excluded from them.
+void getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions );
+void addPool( uint32_t ip1, uint32_t ip2, bool exclusion = false );
+void removePool( uint32_t ip1, uint32_t ip2, bool exclusion = false );
+
 ////////////////////////////////////////
 
 // Acquire the lease for the given IP.
@@ -69,3 +105,46 @@ bool releaseLease( uint32_t ip, const uint8_t *mac = NULL );
 
 ////////////////////////////////////////
 
+// The interface of a backend, with the same calls as above.
+class backend
+{
+public:
+	virtual ~backend( void );
+
+	virtual void threadStart( void ) {}
+	virtual void threadStop( void ) {}
+
+	virtual void startLeaseJournal( void ) {}
+	virtual void startSnapshot( void ) {}
+	virtual void startLeaseSweeper( void ) {}
+
+	virtual int schemaVersion( void ) = 0;
+	virtual void migrateSchema( void ) = 0;
+
+	virtual void getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases ) = 0;
+	virtual void getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts ) = 0;
+	virtual void getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options ) = 0;
+
+	virtual std::vector<uint32_t> getIPAddresses( const uint8_t *mac, bool avail ) = 0;
+	virtual std::vector<std::string> getMACAddresses( uint32_t ip ) = 0;
+	virtual bool addressAvailable( uint32_t ip, const uint8_t *mac ) = 0;
+	virtual void getOptions( uint32_t ip, std::vector<std::string> &options ) = 0;
+
+	virtual void addHost( uint32_t ip, const uint8_t *mac ) = 0;
+	virtual void removeHost( uint32_t ip ) = 0;
+
+	virtual void addOption( uint32_t ip1, uint32_t ip2, const std::string &option, bool replace ) = 0;
+	virtual void removeOption( uint32_t ip1, uint32_t ip2, const std::string &option ) = 0;
+
+	virtual void getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions ) = 0;
+	virtual void addPool( uint32_t ip1, uint32_t ip2, bool exclusion ) = 0;
+	virtual void removePool( uint32_t ip1, uint32_t ip2, bool exclusion ) = 0;
+
+	virtual bool acquireLease( uint32_t ip, const uint8_t *mac, uint32_t time ) = 0;
+	virtual bool releaseLease( uint32_t ip, const uint8_t *mac ) = 0;
+};
+
+// The configured backend (created on first use).
+backend &currentBackend( void );
+
+////////////////////////////////////////
@@ -0,0 +1,112 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+// Time flat_map against std::unordered_map, with random 48-bit keys (as
+// packed MACs): nanoseconds per insert and per lookup.
+//
+// Usage: flat_map_bench [<entries> ...]   (default 1000000 10000000)
+
+#include "flat_map.h"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+	typedef std::chrono::steady_clock bench_clock;
+
+	double nanoseconds( bench_clock::time_point start, size_t ops )
+	{
+		return std::chrono::duration<double, std::nano>( bench_clock::now() - start ).count() / ops;
+	}
+
+	uint64_t found( const flat_map<uint64_t, uint32_t> &, const uint32_t *v )
+	{
+		return v ? *v : 0;
+	}
+
+	uint64_t found( const std::unordered_map<uint64_t, uint32_t> &m, std::unordered_map<uint64_t, uint32_t>::const_iterator v )
+	{
+		return v != m.end() ? v->second : 0;
+	}
+
+	// Insert the keys, then look them all up (in another order).
+	template <typename Map>
+	void measure( const char *name, const std::vector<uint64_t> &keys, const std::vector<uint64_t> &lookups )
+	{
+		Map m;
+
+		bench_clock::time_point start = bench_clock::now();
+		for ( size_t i = 0; i < keys.size(); ++i )
+			m[keys[i]] = uint32_t( i );
+		double insert = nanoseconds( start, keys.size() );
+
+		uint64_t sum = 0;
+		start = bench_clock::now();
+		for ( uint64_t k: lookups )
+		{
+			auto v = m.find( k );
+			sum += found( m, v );
+		}
+		double lookup = nanoseconds( start, lookups.size() );
+
+		std::cout << "  " << name << ": insert " << insert << " ns, lookup " << lookup << " ns (" << sum << ")" << std::endl;
+	}
+}
+
+////////////////////////////////////////
+
+int main( int argc, char *argv[] )
+{
+	std::vector<size_t> sizes;
+	for ( int i = 1; i < argc; ++i )
+		sizes.push_back( strtoul( argv[i], NULL, 10 ) );
+	if ( sizes.empty() )
+		sizes = { 1000000, 10000000 };
+
+	std::mt19937_64 random( 42 );
+	for ( size_t n: sizes )
+	{
+		std::vector<uint64_t> keys( n );
+		for ( uint64_t &k: keys )
+			k = random() & 0xFFFFFFFFFFFFull;
+		std::vector<uint64_t> lookups( keys );
+		std::shuffle( lookups.begin(), lookups.end(), random );
+
+		std::cout << n << " entries:" << std::endl;
+		measure< flat_map<uint64_t, uint32_t> >( "flat_map", keys, lookups );
+		measure< std::unordered_map<uint64_t, uint32_t> >( "unordered_map", keys, lookups );
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,107 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+// Lease changes per second of the lease store: threads acquire and
+// release leases on their own addresses, while the store is checkpointed
+// every second (as by the sweeper of the native backend).
+//
+// Usage: lease_store_bench [<file> [<threads> [<seconds>]]]
+// The store (and its log) are created in the current directory by
+// default; give a file on the disk to measure.
+
+#include "lease_store.h"
+
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	typedef std::chrono::steady_clock bench_clock;
+
+	const uint32_t network = 0x0A000000;
+}
+
+////////////////////////////////////////
+
+int main( int argc, char *argv[] )
+{
+	std::string file = argc > 1 ? argv[1] : "lease_store_bench.store";
+	size_t threads = argc > 2 ? strtoul( argv[2], NULL, 10 ) : 16;
+	int seconds = argc > 3 ? atoi( argv[3] ) : 5;
+
+	remove( file.c_str() );
+	remove( ( file + ".log" ).c_str() );
+
+	{
+		lease_store store( file, htonl( network ), 16, 262144 );
+		std::atomic<bool> done( false );
+		std::atomic<uint64_t> changes( 0 );
+
+		bench_clock::time_point start = bench_clock::now();
+		std::vector<std::thread> workers;
+		for ( size_t t = 0; t < threads; ++t )
+		{
+			workers.emplace_back( [&, t]()
+			{
+				uint8_t mac[6] = { 0x02, 0x00, 0x00, uint8_t( t ), 0x00, 0x00 };
+				uint32_t ip = htonl( network + uint32_t( t * 4096 % 65536 ) );
+				time_t expires;
+				while ( !done )
+				{
+					store.acquire( ip, mac, 3600, expires );
+					store.release( ip, mac );
+					changes += 2;
+				}
+			} );
+		}
+
+		while ( bench_clock::now() - start < std::chrono::seconds( seconds ) )
+		{
+			std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+			store.checkpoint();
+		}
+		done = true;
+		for ( std::thread &w: workers )
+			w.join();
+
+		double elapsed = std::chrono::duration<double>( bench_clock::now() - start ).count();
+		std::cout << threads << " threads: " << changes << " changes in " << elapsed << " s, "
+			<< uint64_t( changes / elapsed ) << " changes/s" << std::endl;
+	}
+
+	remove( file.c_str() );
+	remove( ( file + ".log" ).c_str() );
+	return 0;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,146 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+// NAKs under concurrent DISCOVER/REQUEST load against the memory backend.
+// Each thread plays a server handling clients one after another: on the
+// DISCOVER it picks an address, and on the REQUEST (after the delay of
+// the client's round trip) it acquires the lease, or NAKs.  The threads
+// don't share offers, as with several servers sharing a database.
+//
+// Two strategies are compared:
+//   lowest: the lowest free address, with no retry (as before)
+//   spread: the search starts at a hash of the MAC, and the other
+//           candidates are tried when the address was taken
+//
+// Usage: nak_bench [<threads> [<clients per thread> [<delay us>]]]
+
+#include "address_pool.h"
+#include "config.h"
+#include "memory_backend.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	struct counts
+	{
+		std::atomic<uint64_t> naks;
+		std::atomic<uint64_t> retries;
+	};
+
+	// The first free address in the pool (network order), or 0.
+	uint32_t lowestFree( memory_backend &b, uint32_t first, uint32_t last, const uint8_t *mac )
+	{
+		for ( uint32_t ip = first; ip <= last; ++ip )
+		{
+			if ( b.addressAvailable( htonl( ip ), mac ) )
+				return htonl( ip );
+		}
+		return 0;
+	}
+
+	void serve( memory_backend &b, bool spread, size_t thread, size_t clients, uint32_t first, uint32_t last, int delay, counts &c )
+	{
+		for ( size_t i = 0; i < clients; ++i )
+		{
+			uint8_t mac[6] = { 0x02, 0x00, uint8_t( thread >> 8 ), uint8_t( thread ), uint8_t( i >> 8 ), uint8_t( i ) };
+
+			// DISCOVER
+			std::vector<uint32_t> ips;
+			if ( spread )
+				ips = b.getIPAddresses( mac, true );
+			else if ( uint32_t ip = lowestFree( b, first, last, mac ) )
+				ips.push_back( ip );
+			if ( ips.empty() )
+			{
+				c.naks.fetch_add( 1 );
+				continue;
+			}
+
+			std::this_thread::sleep_for( std::chrono::microseconds( delay ) );
+
+			// REQUEST
+			bool leased = b.acquireLease( ips[0], mac, 3600 );
+			for ( size_t k = 1; spread && !leased && k < ips.size(); ++k )
+			{
+				c.retries.fetch_add( 1 );
+				leased = b.acquireLease( ips[k], mac, 3600 );
+			}
+			if ( !leased )
+				c.naks.fetch_add( 1 );
+		}
+	}
+
+	void run( memory_backend &b, bool spread, size_t threads, size_t clients, uint32_t first, uint32_t last, int delay )
+	{
+		counts c;
+		c.naks = 0;
+		c.retries = 0;
+
+		std::vector<std::thread> servers;
+		for ( size_t t = 0; t < threads; ++t )
+			servers.emplace_back( serve, std::ref( b ), spread, t, clients, first, last, delay, std::ref( c ) );
+		for ( std::thread &t: servers )
+			t.join();
+
+		uint64_t total = threads * clients;
+		std::cout << ( spread ? "spread" : "lowest" ) << ": " << total << " transactions, transactions_nak "
+			<< c.naks << " (" << 100.0 * c.naks / total << "%), lease_retries " << c.retries << std::endl;
+
+		// Free the pool for the next run
+		for ( uint32_t ip = first; ip <= last; ++ip )
+			b.releaseLease( htonl( ip ), NULL );
+	}
+}
+
+////////////////////////////////////////
+
+int main( int argc, char *argv[] )
+{
+	size_t threads = argc > 1 ? strtoul( argv[1], NULL, 10 ) : 8;
+	size_t clients = argc > 2 ? strtoul( argv[2], NULL, 10 ) : 500;
+	int delay = argc > 3 ? atoi( argv[3] ) : 200;
+
+	// Twice as many addresses as clients
+	configuration["backend"] = "memory";
+	memory_backend b;
+	uint32_t first = 0x0A000001;
+	uint32_t last = first + uint32_t( 2 * threads * clients ) - 1;
+	b.addPool( htonl( first ), htonl( last ), false );
+
+	run( b, false, threads, clients, first, last, delay );
+	run( b, true, threads, clients, first, last, delay );
+
+	return 0;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,193 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+// Queries per second of the host and option lookups against a local
+// MySQL database, built as text queries (as before prepared statements)
+// and as prepared statements.
+//
+// Usage: query_bench [<config> [<seconds>]]
+// The database settings are read from the config (/etc/dhcpdb.conf).
+
+#include "config.h"
+#include "error.h"
+#include "format.h"
+#include "guard.h"
+#include "statement.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	typedef std::chrono::steady_clock bench_clock;
+
+	MYSQL *connect( void )
+	{
+		MYSQL *db = mysql_init( NULL );
+		if ( db == NULL )
+			error( "Unable to init library" );
+
+		if ( mysql_real_connect( db, configuration["dbhost"].c_str(), configuration["dbuser"].c_str(), configuration["dbpassword"].c_str(), configuration["database"].c_str(), 0, NULL, 0 ) == NULL )
+		{
+			std::string msg = mysql_error( db );
+			mysql_close( db );
+			error( "Unable to open mysql: " + msg );
+		}
+		return db;
+	}
+
+	// The MAC and IP of some hosts to look up.
+	void sampleHosts( MYSQL *db, std::vector<std::string> &macs, std::vector<uint32_t> &ips )
+	{
+		if ( mysql_query( db, "SELECT mac_addr, ip_addr FROM dhcp_host LIMIT 1000" ) != 0 )
+			error( format( "Error querying mysql: {0}", mysql_error( db ) ) );
+
+		MYSQL_RES *result = mysql_store_result( db );
+		auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
+		if ( result == NULL )
+			error( format( "Error storing result from mysql: {0}", mysql_error( db ) ) );
+
+		MYSQL_ROW row;
+		while ( ( row = mysql_fetch_row( result ) ) )
+		{
+			unsigned long *lengths = mysql_fetch_lengths( result );
+			if ( row[0] && row[1] && lengths[0] == 6 )
+			{
+				macs.push_back( std::string( row[0], 6 ) );
+				ips.push_back( htonl( strtoul( row[1], NULL, 10 ) ) );
+			}
+		}
+
+		if ( macs.empty() )
+			error( "No hosts in dhcp_host to look up" );
+	}
+
+	// Run a text query and read all the rows.
+	size_t textQuery( MYSQL *db, const std::string &query )
+	{
+		if ( mysql_query( db, query.c_str() ) != 0 )
+			error( format( "Error querying mysql: {0}", mysql_error( db ) ) );
+
+		MYSQL_RES *result = mysql_store_result( db );
+		auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
+		if ( result == NULL )
+			error( format( "Error storing result from mysql: {0}", mysql_error( db ) ) );
+
+		size_t rows = 0;
+		while ( mysql_fetch_row( result ) )
+			++rows;
+		return rows;
+	}
+
+	// Run the lookups for the given time, returning queries per second.
+	template <typename Lookup>
+	double measure( const char *name, int seconds, size_t hosts, Lookup lookup )
+	{
+		size_t queries = 0;
+		bench_clock::time_point start = bench_clock::now();
+		bench_clock::time_point end = start + std::chrono::seconds( seconds );
+		while ( bench_clock::now() < end )
+		{
+			for ( size_t i = 0; i < hosts; ++i )
+				queries += lookup( i );
+		}
+
+		double elapsed = std::chrono::duration<double>( bench_clock::now() - start ).count();
+		double qps = queries / elapsed;
+		std::cout << name << ": " << queries << " queries in " << elapsed << "s, " << size_t( qps ) << " queries/s" << std::endl;
+		return qps;
+	}
+}
+
+////////////////////////////////////////
+
+int main( int argc, char *argv[] )
+{
+	try
+	{
+		parse_config( argc > 1 ? argv[1] : "/etc/dhcpdb.conf" );
+		int seconds = argc > 2 ? atoi( argv[2] ) : 10;
+
+		MYSQL *db = connect();
+		auto closedb = make_guard( [=](){ mysql_close( db ); } );
+		statement_cache statements( db );
+
+		std::vector<std::string> macs;
+		std::vector<uint32_t> ips;
+		sampleHosts( db, macs, ips );
+
+		// Before: the queries formatted as text, with the values inline
+		double before = measure( "text", seconds, macs.size(), [&]( size_t i )
+		{
+			textQuery( db, format(
+				"SELECT ip_addr FROM dhcp_host "
+					"WHERE mac_addr=x'{0,B16,f0,w2}' OR mac_addr=x'000000000000' "
+					"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC",
+				as_hex<uint8_t>( reinterpret_cast<const uint8_t *>( macs[i].data() ), 6 ) ) );
+			textQuery( db, format(
+				"SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options "
+					"WHERE ( {0} >= ip_addr_from AND {0} <= ip_addr_to )",
+				ntohl( ips[i] ) ) );
+			return 2;
+		} );
+
+		// After: the same queries as prepared statements
+		double after = measure( "prepared", seconds, macs.size(), [&]( size_t i )
+		{
+			statement &h = prepared( statements,
+				"SELECT ip_addr FROM dhcp_host "
+					"WHERE mac_addr = ? OR mac_addr = x'000000000000' "
+					"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC", "u" );
+			h.bind( 0, macs[i] );
+			if ( !h.execute() )
+				error( format( "Error querying mysql: {0}", h.error() ) );
+			while ( h.fetch() );
+
+			statement &o = prepared( statements, "SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options WHERE ( ? >= ip_addr_from AND ? <= ip_addr_to )", "uus" );
+			o.bind( 0, ntohl( ips[i] ) );
+			o.bind( 1, ntohl( ips[i] ) );
+			if ( !o.execute() )
+				error( format( "Error querying mysql: {0}", o.error() ) );
+			while ( o.fetch() );
+			return 2;
+		} );
+
+		std::cout << "prepared/text: " << after / before << std::endl;
+	}
+	catch ( std::exception &e )
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,168 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#include "client_filter.h"
+#include "config.h"
+#include "flat_map.h"
+#include "stats.h"
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+
+namespace
+{
+	typedef std::chrono::steady_clock cache_clock;
+
+	stat_counter lookups( "unknown_client_lookups" );
+	stat_counter filter_hits( "unknown_client_filter_hits" );
+	stat_counter negative_hits( "unknown_client_negative_hits" );
+
+	// A Bloom filter with about 10 bits and 4 probes per MAC address,
+	// for a false positive rate of around 1%.
+	class bloom_filter
+	{
+	public:
+		bloom_filter( const std::vector<uint64_t> &macs, bool dynamic )
+			: _mask( 1023 ), _dynamic( dynamic )
+		{
+			while ( _mask + 1 < macs.size() * 10 )
+				_mask = _mask * 2 + 1;
+			_bits.resize( ( _mask + 1 ) / 64 );
+
+			for ( uint64_t m: macs )
+			{
+				uint64_t h1, h2;
+				hash( m, h1, h2 );
+				for ( int i = 0; i < probes; ++i )
+				{
+					uint64_t b = ( h1 + i * h2 ) & _mask;
+					_bits[b / 64] |= uint64_t( 1 ) << ( b % 64 );
+				}
+			}
+		}
+
+		bool dynamic( void ) const
+		{
+			return _dynamic;
+		}
+
+		bool mayContain( uint64_t m ) const
+		{
+			uint64_t h1, h2;
+			hash( m, h1, h2 );
+			for ( int i = 0; i < probes; ++i )
+			{
+				uint64_t b = ( h1 + i * h2 ) & _mask;
+				if ( ( _bits[b / 64] & ( uint64_t( 1 ) << ( b % 64 ) ) ) == 0 )
+					return false;
+			}
+			return true;
+		}
+
+	private:
+		static const int probes = 4;
+
+		static void hash( uint64_t m, uint64_t &h1, uint64_t &h2 )
+		{
+			uint64_t h = m * 0x9E3779B97F4A7C15ull;
+			h ^= h >> 32;
+			h *= 0xD6E8FEB86659FD93ull;
+			h1 = h ^ ( h >> 32 );
+			h2 = ( h >> 17 ) | 1;
+		}
+
+		uint64_t _mask;
+		bool _dynamic;
+		std::vector<uint64_t> _bits;
+	};
+
+	std::shared_ptr<const bloom_filter> filter;
+
+	std::mutex negative_mutex;
+	flat_map<uint64_t, cache_clock::time_point> negative;
+
+	const size_t max_negative = 65536;
+}
+
+////////////////////////////////////////
+
+bool unknownClient( const uint8_t *mac )
+{
+	lookups.add();
+	uint64_t m = pack_mac( mac );
+
+	std::shared_ptr<const bloom_filter> f = std::atomic_load( &filter );
+	if ( f && !f->dynamic() && !f->mayContain( m ) )
+	{
+		filter_hits.add();
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock( negative_mutex );
+	if ( const cache_clock::time_point *expires = negative.find( m ) )
+	{
+		if ( *expires > cache_clock::now() )
+		{
+			negative_hits.add();
+			return true;
+		}
+		negative.erase( m );
+	}
+	return false;
+}
+
+////////////////////////////////////////
+
+void noAddresses( const uint8_t *mac )
+{
+	static const std::chrono::seconds ttl( config_int( "client_negative_ttl", 30 ) );
+	if ( ttl.count() <= 0 )
+		return;
+
+	cache_clock::time_point now = cache_clock::now();
+
+	std::unique_lock<std::mutex> lock( negative_mutex );
+	if ( negative.size() >= max_negative )
+	{
+		negative.erase_if( [=]( uint64_t, cache_clock::time_point expires ) { return expires <= now; } );
+		if ( negative.size() >= max_negative )
+			negative.clear();
+	}
+	negative[pack_mac( mac )] = now + ttl;
+}
+
+////////////////////////////////////////
+
+void loadClientFilter( const std::vector<uint64_t> &macs, bool dynamic )
+{
+	std::atomic_store( &filter, std::shared_ptr<const bloom_filter>( std::make_shared<bloom_filter>( macs, dynamic ) ) );
+
+	// The hosts have changed, so clients may have an address now
+	std::unique_lock<std::mutex> lock( negative_mutex );
+	negative.clear();
+}
+
+////////////////////////////////////////
+
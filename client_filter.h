@@ -0,0 +1,49 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+////////////////////////////////////////
+
+// Clients that can never be given an address are turned away without
+// a database query.  A Bloom filter holds the MAC addresses with hosts
+// set aside for them, which decides when there are no dynamic addresses.
+// Clients that were recently given nothing are remembered for
+// client_negative_ttl seconds.
+
+// True if there is no address for the client.
+bool unknownClient( const uint8_t *mac );
+
+// Remember that the client could not be given an address.
+void noAddresses( const uint8_t *mac );
+
+// Replace the MAC addresses (packed) with hosts set aside for them.
+// When dynamic is true any client might get an address, so only the
+// clients remembered by noAddresses are turned away.
+void loadClientFilter( const std::vector<uint64_t> &macs, bool dynamic );
+
+////////////////////////////////////////
+
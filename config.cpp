@@ -55,6 +55,10 @@ void parse_config( const std::string &filename )
 				std::vector<std::string> optargs;
 				parse_function( val, name, optargs );
 
+				// An option without arguments, like "name()".
+				if ( optargs.size() == 1 && optargs[0].empty() )
+					optargs.clear();
+
 				std::vector<Type> args;
 				for ( size_t i = 0; i < optargs.size(); ++i )
 				{
@@ -121,3 +125,35 @@ void parse_config( const std::string &filename )
 	}
 }
 
+////////////////////////////////////////
+
+int config_int( const std::string &key, int def )
+{
+	auto v = configuration.find( key );
+	if ( v == configuration.end() || v->second.empty() )
+		return def;
+
+	try
+	{
+		return std::stoi( v->second );
+	}
+	catch ( ... )
+	{
+		error( format( "Invalid number for '{0}': {1}", key, v->second ) );
+	}
+	return def;
+}
+
+////////////////////////////////////////
+
+bool config_bool( const std::string &key, bool def )
+{
+	auto v = configuration.find( key );
+	if ( v == configuration.end() || v->second.empty() )
+		return def;
+
+	const std::string &val = v->second;
+	return ( val == "yes" || val == "true" || val == "on" );
+}
+
+////////////////////////////////////////
@@ -26,3 +26,7 @@ extern std::map<int,std::string> dhcp_names;
 extern std::map<int,std::vector<Type>> dhcp_args;
 
 void parse_config( const std::string &filename );
+
+// Lookup a configuration value, returning the default when it is not set.
+int config_int( const std::string &key, int def );
+bool config_bool( const std::string &key, bool def );
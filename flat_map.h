@@ -0,0 +1,295 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+////////////////////////////////////////
+
+// Open-addressing hash table for integer keys (IPv4 addresses and packed
+// 48-bit MAC addresses).  Slots are kept in one flat array with a byte of
+// control data each: the control bytes of a group of 16 slots are
+// compared at once (with SSE2 when available) to find candidate slots.
+template <typename Key, typename Value>
+class flat_map
+{
+public:
+	flat_map( void )
+	{
+	}
+
+	size_t size( void ) const
+	{
+		return _size;
+	}
+
+	bool empty( void ) const
+	{
+		return _size == 0;
+	}
+
+	void clear( void )
+	{
+		_ctrl.clear();
+		_slots.clear();
+		_size = 0;
+		_deleted = 0;
+	}
+
+	// Make room for n entries.
+	void reserve( size_t n )
+	{
+		size_t cap = group_size;
+		while ( cap * 7 / 8 < n )
+			cap *= 2;
+		if ( cap > _slots.size() )
+			rehash( cap );
+	}
+
+	// Get the value for the key, or NULL if not found.
+	Value *find( Key key )
+	{
+		size_t i = lookup( key );
+		return i == npos ? NULL : &_slots[i].second;
+	}
+
+	const Value *find( Key key ) const
+	{
+		size_t i = lookup( key );
+		return i == npos ? NULL : &_slots[i].second;
+	}
+
+	// Get the value for the key, adding a default value if not found.
+	Value &operator[]( Key key )
+	{
+		size_t i = lookup( key );
+		if ( i != npos )
+			return _slots[i].second;
+
+		if ( ( _size + _deleted + 1 ) * 8 > _slots.size() * 7 )
+			rehash( _size * 8 >= _slots.size() * 3 ? std::max( _slots.size() * 2, size_t( group_size ) ) : _slots.size() );
+
+		uint64_t h = hash( key );
+		i = insertSlot( h );
+		_slots[i].first = key;
+		_slots[i].second = Value();
+		return _slots[i].second;
+	}
+
+	// Remove the key, returning false if it was not found.
+	bool erase( Key key )
+	{
+		size_t i = lookup( key );
+		if ( i == npos )
+			return false;
+		eraseSlot( i );
+		return true;
+	}
+
+	// Remove the entries for which pred( key, value ) is true.
+	template <typename Pred>
+	void erase_if( Pred pred )
+	{
+		for ( size_t i = 0; i < _slots.size(); ++i )
+		{
+			if ( isFull( _ctrl[i] ) && pred( _slots[i].first, _slots[i].second ) )
+				eraseSlot( i );
+		}
+	}
+
+	// Call f( key, value ) for every entry.
+	template <typename Func>
+	void for_each( Func f ) const
+	{
+		for ( size_t i = 0; i < _slots.size(); ++i )
+		{
+			if ( isFull( _ctrl[i] ) )
+				f( _slots[i].first, _slots[i].second );
+		}
+	}
+
+private:
+	enum : uint8_t
+	{
+		EMPTY = 0x80,
+		DELETED = 0xFE
+	};
+
+	static const size_t group_size = 16;
+	static const size_t npos = size_t( -1 );
+
+	static bool isFull( uint8_t c )
+	{
+		return ( c & 0x80 ) == 0;
+	}
+
+	static uint64_t hash( Key key )
+	{
+		uint64_t h = uint64_t( key ) * 0x9E3779B97F4A7C15ull;
+		return h ^ ( h >> 29 );
+	}
+
+	// Bit mask of the slots in the group with the control byte c.
+	static uint32_t match( const uint8_t *group, uint8_t c )
+	{
+#ifdef __SSE2__
+		__m128i g = _mm_loadu_si128( reinterpret_cast<const __m128i *>( group ) );
+		return uint32_t( _mm_movemask_epi8( _mm_cmpeq_epi8( g, _mm_set1_epi8( char( c ) ) ) ) );
+#else
+		uint32_t m = 0;
+		for ( size_t i = 0; i < group_size; ++i )
+			m |= uint32_t( group[i] == c ) << i;
+		return m;
+#endif
+	}
+
+	// Bit mask of the empty or deleted slots in the group.
+	static uint32_t matchFree( const uint8_t *group )
+	{
+#ifdef __SSE2__
+		__m128i g = _mm_loadu_si128( reinterpret_cast<const __m128i *>( group ) );
+		return uint32_t( _mm_movemask_epi8( g ) );
+#else
+		uint32_t m = 0;
+		for ( size_t i = 0; i < group_size; ++i )
+			m |= uint32_t( group[i] >> 7 ) << i;
+		return m;
+#endif
+	}
+
+	size_t lookup( Key key ) const
+	{
+		if ( _slots.empty() )
+			return npos;
+
+		uint64_t h = hash( key );
+		uint8_t tag = uint8_t( h & 0x7F );
+		size_t mask = _slots.size() / group_size - 1;
+		size_t g = ( h >> 7 ) & mask;
+		for ( size_t step = 1; ; ++step )
+		{
+			const uint8_t *group = &_ctrl[g * group_size];
+			for ( uint32_t m = match( group, tag ); m; m &= m - 1 )
+			{
+				size_t i = g * group_size + __builtin_ctz( m );
+				if ( _slots[i].first == key )
+					return i;
+			}
+			if ( match( group, EMPTY ) )
+				return npos;
+			g = ( g + step ) & mask;
+		}
+	}
+
+	size_t insertSlot( uint64_t h )
+	{
+		size_t mask = _slots.size() / group_size - 1;
+		size_t g = ( h >> 7 ) & mask;
+		for ( size_t step = 1; ; ++step )
+		{
+			uint32_t m = matchFree( &_ctrl[g * group_size] );
+			if ( m )
+			{
+				size_t i = g * group_size + __builtin_ctz( m );
+				if ( _ctrl[i] == DELETED )
+					--_deleted;
+				_ctrl[i] = uint8_t( h & 0x7F );
+				++_size;
+				return i;
+			}
+			g = ( g + step ) & mask;
+		}
+	}
+
+	void eraseSlot( size_t i )
+	{
+		// A group that was never full can't be in the middle of a probe
+		size_t g = i / group_size * group_size;
+		if ( match( &_ctrl[g], EMPTY ) )
+			_ctrl[i] = EMPTY;
+		else
+		{
+			_ctrl[i] = DELETED;
+			++_deleted;
+		}
+		_slots[i].second = Value();
+		--_size;
+	}
+
+	void rehash( size_t cap )
+	{
+		std::vector<uint8_t> ctrl( cap, EMPTY );
+		std::vector< std::pair<Key,Value> > slots( cap );
+		ctrl.swap( _ctrl );
+		slots.swap( _slots );
+		_size = 0;
+		_deleted = 0;
+
+		for ( size_t i = 0; i < slots.size(); ++i )
+		{
+			if ( isFull( ctrl[i] ) )
+			{
+				size_t j = insertSlot( hash( slots[i].first ) );
+				_slots[j].first = slots[i].first;
+				_slots[j].second = std::move( slots[i].second );
+			}
+		}
+	}
+
+	std::vector<uint8_t> _ctrl;
+	std::vector< std::pair<Key,Value> > _slots;
+	size_t _size = 0;
+	size_t _deleted = 0;
+};
+
+////////////////////////////////////////
+
+// Pack a 6 byte MAC address into an integer key, and back.
+inline uint64_t pack_mac( const uint8_t *mac )
+{
+	uint64_t m = 0;
+	for ( int i = 0; i < 6; ++i )
+		m = ( m << 8 ) | mac[i];
+	return m;
+}
+
+inline std::string unpack_mac( uint64_t mac )
+{
+	std::string m( 6, '\0' );
+	for ( int i = 5; i >= 0; --i, mac >>= 8 )
+		m[i] = char( mac & 0xFF );
+	return m;
+}
+
+////////////////////////////////////////
+
@@ -9,20 +9,37 @@
 #include <syslog.h>
 
 #include <algorithm>
-#include <set>
+#include <bitset>
 
 #include "lookup.h"
+#include "hostname_cache.h"
 #include "udp_socket.h"
 #include "packet.h"
 #include "packet_queue.h"
 #include "error.h"
 #include "backend.h"
+#include "client_filter.h"
 #include "format.h"
 #include "option.h"
+#include "offer_table.h"
+#include "option_cache.h"
+#include "reply_cache.h"
 #include "config.h"
+#include "lease_cache.h"
+#include "log.h"
+#include "stats.h"
 
 std::mutex printmutex;
 
+namespace
+{
+	stat_counter rapid_transactions( "transactions_rapid_commit" );
+	stat_counter four_message_transactions( "transactions_four_message" );
+	stat_counter lazy_renewals( "lease_renewals_cached" );
+	stat_counter lease_retries( "lease_retries" );
+	stat_counter naks( "transactions_nak" );
+}
+
 ////////////////////////////////////////
 
 void extractOptions( packet *p, std::vector<std::string> &opts )
@@ -49,6 +66,32 @@ void extractOptions( packet *p, std::vector<std::string> &opts )
 
 ////////////////////////////////////////
 
+// Get the parameter request list sent by the client.
+std::string parameterList( packet *p )
+{
+	std::vector<std::string> copts;
+	extractOptions( p, copts );
+	for ( std::string &o: copts )
+	{
+		if ( o[0] == DOP_PARAMETER_REQUEST_LIST )
+			return o.substr( 2 );
+	}
+
+	return std::string();
+}
+
+////////////////////////////////////////
+
+std::bitset<256> requestedOptions( const std::string &prl )
+{
+	std::bitset<256> requested;
+	for ( char c: prl )
+		requested.set( uint8_t( c ) );
+	return requested;
+}
+
+////////////////////////////////////////
+
 void fillOptions( packet *p, const std::vector<std::string> &opts )
 {
 	uint8_t *options = p->options;
@@ -62,12 +105,6 @@ void fillOptions( packet *p, const std::vector<std::string> &opts )
 		if( o.empty() )
 			continue;
 
-		if ( o[0] == DOP_TFTP_SERVERNAME )
-		{
-			p->siaddr = dns_lookup( &o[2] );
-			continue;
-		}
-
 		if ( o[0] == DOP_BOOT_FILENAME )
 		{
 			size_t n = uint8_t(o[1]);
@@ -84,99 +121,114 @@ void fillOptions( packet *p, const std::vector<std::string> &opts )
 
 ////////////////////////////////////////
 
-void replyDiscover( packet *p, packet_queue &q, uint32_t ip, uint32_t server_ip, const char *hostname )
+std::string timeOption( uint8_t code, uint32_t t )
 {
-	// Find the requested parameter list.
-	std::set<char> requested;
+	std::string o( 6, '\0' );
+	o[0] = code;
+	o[1] = 4;
+	for ( int i = 5; i > 1; --i, t >>= 8 )
+		o[i] = t & 0xFF;
+	return o;
+}
+
+////////////////////////////////////////
+
+// Change the lease, renewal and rebinding times in a reply.
+void setLeaseTimes( packet *reply, uint32_t lease, const option_block &block )
+{
+	uint32_t times[3] =
 	{
-		std::vector<std::string> copts;
-		extractOptions( p, copts );
-		for ( std::string &o: copts )
+		lease,
+		uint32_t( uint64_t( block.renewal_time ) * lease / block.lease_time ),
+		uint32_t( uint64_t( block.rebinding_time ) * lease / block.lease_time )
+	};
+
+	uint8_t *options = reply->options + 4;
+	uint8_t *end = reply->options + sizeof(reply->options);
+	while ( options + 1 < end && *options != DOP_END_OPTION )
+	{
+		if ( *options == DOP_PADDING )
 		{
-			if ( o[0] == DOP_PARAMETER_REQUEST_LIST )
-			{
-				for ( size_t i = 2; i < o.size(); ++i )
-					requested.insert( o[i] );
-			}
+			options++;
+			continue;
+		}
+
+		int i = -1;
+		switch ( *options )
+		{
+			case DOP_IP_ADDRESS_LEASETIME: i = 0; break;
+			case DOP_RENEWAL_TIMEVALUE: i = 1; break;
+			case DOP_REBINDING_TIMEVALUE: i = 2; break;
+			default: break;
 		}
+
+		if ( i >= 0 && options[1] == 4 )
+		{
+			std::string o = timeOption( *options, times[i] );
+			memcpy( options, o.data(), o.size() );
+		}
+
+		options += 2 + options[1];
 	}
+}
 
-	// Create a reply packet
-	packet *reply = q.alloc();
+////////////////////////////////////////
+
+void replyHeader( packet *p, packet *reply, uint32_t ip )
+{
 	memset( reply, 0, sizeof(packet) );
 	reply->op = BOOT_REPLY;
 	reply->htype = p->htype;
 	reply->hlen = p->hlen;
 	reply->xid = p->xid;
+	reply->flags = p->flags;
+	reply->yiaddr = ip;
 	memcpy( reply->chaddr, p->chaddr, p->hlen );
-	uint8_t *hwaddr = reply->chaddr;
+}
 
-	// Find an IP address (prefer the one given, if any)
-	{
-		std::vector<uint32_t> ips = getIPAddresses( hwaddr, true );
-		if ( ips.empty() )
-		{
-			syslog( LOG_INFO, "Unable to offer an address to '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'",
-				hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
-			return;
-		}
-		if ( std::find( ips.begin(), ips.end(), ip ) == ips.end() )
-			ip = ips[0];
-	}
+////////////////////////////////////////
 
-	reply->yiaddr = ip;
+// Build an OFFER or ACK for the IP, with the options requested by the client.
+// A rapid commit ACK also carries the rapid commit option.
+void buildReply( packet *p, packet *reply, uint32_t ip, uint32_t server_ip, MsgType type, const option_block &block, const std::string &prl, bool rapid )
+{
+	if ( findReply( p, ip, server_ip, prl, rapid, type, reply ) )
+		return;
 
+	replyHeader( p, reply, ip );
 
 	// Find the requested options
-	std::string lease;
-	std::string server;
-
+	std::bitset<256> requested = requestedOptions( prl );
 	std::vector<std::string> options;
-	{
-		std::vector<std::string> tmp;
-		getOptions( ip, tmp );
+	block.requested( requested, options );
 
-		// Add the hostname
-		std::string hostname;
-		for ( std::string &o: tmp )
-		{
-			if ( o.empty() )
-				continue;
-
-			if ( o[0] == DOP_HOSTNAME )
-			{
-				hostname = o;
-				continue;
-			}
-
-			if ( o[0] == DOP_IP_ADDRESS_LEASETIME )
-			{
-				lease = o;
-				continue;
-			}
-
-			if ( o[0] == DOP_SERVER_IDENTIFIER )
-			{
-				server = o;
-				continue;
-			}
-
-			if ( requested.find( o[0] ) != requested.end() )
-				options.push_back( o );
-		}
+	// Add the TFTP server and the hostname (don't cache the reply until
+	// they are known)
+	bool cacheable = true;
+	if ( requested.test( DOP_TFTP_SERVERNAME ) && !block.tftp_server.empty() )
+	{
+		uint32_t tftp = 0;
+		cacheable = cachedAddress( block.tftp_server, tftp );
+		reply->siaddr = tftp;
+	}
 
-		if ( hostname.empty() )
+	std::string hostname = block.hostname;
+	if ( hostname.empty() )
+	{
+		if ( !cachedHostname( ip, hostname ) )
+			cacheable = false;
+		if ( !hostname.empty() )
 		{
-			try { hostname = ip_lookup( ip, false, false ); } catch ( ... ) {}
-			if ( !hostname.empty() )
-				options.push_back( format( "{0}{1}{2}", char(DOP_HOSTNAME), char(hostname.size()), hostname ) );
+			hostname.resize( std::min<size_t>( hostname.size(), 255 ) );
+			options.push_back( format( "{0}{1}{2}", char(DOP_HOSTNAME), char(hostname.size()), hostname ) );
 		}
-		else
-			options.push_back( hostname );
-
-		std::sort( options.begin(), options.end() );
 	}
+	else
+		options.push_back( hostname );
+
+	std::sort( options.begin(), options.end() );
 
+	std::string server = block.server;
 	if ( server.empty() )
 	{
 		// Use the current server IP by default.
@@ -186,168 +238,207 @@ void replyDiscover( packet *p, packet_queue &q, uint32_t ip, uint32_t server_ip,
 	}
 
 	// Add mandatory options
-	if ( !lease.empty() )
-		options.insert( options.begin(), lease );
+	if ( !block.lease.empty() )
+	{
+		options.insert( options.begin(), timeOption( DOP_REBINDING_TIMEVALUE, block.rebinding_time ) );
+		options.insert( options.begin(), timeOption( DOP_RENEWAL_TIMEVALUE, block.renewal_time ) );
+		options.insert( options.begin(), block.lease );
+	}
 	options.insert( options.begin(), server );
-	options.insert( options.begin(), format( "{0,n3}", char(53), char(1), char(DHCP_OFFER) ) );
+	if ( rapid )
+		options.insert( options.begin(), format( "{0,n2}", char(DOP_RAPID_COMMIT), char(0) ) );
+	options.insert( options.begin(), format( "{0,n3}", char(53), char(1), char(type) ) );
 
 	fillOptions( reply, options );
 
-	// Send the packet
-	udp_socket client( server_ip, 67, true );
-	client.send( INADDR_BROADCAST, 68, reply );
-
-	syslog( LOG_INFO, "Offered %s to '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'",
-		ip_string( reply->yiaddr ).c_str(), hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
-
-	q.free( reply );
+	if ( cacheable )
+		storeReply( p, ip, server_ip, prl, rapid, reply );
 }
 
 ////////////////////////////////////////
 
-void replyRequest( packet *p, packet_queue &q, uint32_t ip, uint32_t server_ip, const char *hostname )
+// Acquire the lease on the IP for the client and send an ACK (or a NAK).
+// If the server chose the IP, the other candidates are tried in turn when
+// another server takes the IP first.
+void replyLease( packet *p, packet_queue &q, uint32_t ip, uint32_t server_ip, std::shared_ptr<const option_block> block,
+	const std::string &prl, bool rapid, const std::vector<uint32_t> &candidates = std::vector<uint32_t>() )
 {
-	// Find the requested parameter list.
-	std::set<char> requested;
+	static const uint32_t renew_percent = config_int( "lease_renew_percent", 0 );
+
+	const uint8_t *hwaddr = p->chaddr;
+	packet *reply = q.alloc();
+
+	// Early renewals are acknowledged with what is left of the current
+	// lease, as long as that is more than lease_renew_percent of the lease.
+	bool leased = false;
+	uint32_t remaining = 0;
+	time_t expires = 0;
+	if ( renew_percent > 0 && block->lease_time > 0 && cachedLease( ip, hwaddr, expires ) )
 	{
-		std::vector<std::string> copts;
-		extractOptions( p, copts );
-		for ( std::string &o: copts )
+		time_t left = expires - time( NULL );
+		if ( left > 0 && uint64_t( left ) * 100 >= uint64_t( block->lease_time ) * renew_percent )
 		{
-			if ( o[0] == DOP_PARAMETER_REQUEST_LIST )
-			{
-				for ( size_t i = 2; i < o.size(); ++i )
-					requested.insert( o[i] );
-			}
+			remaining = std::min<uint64_t>( left, block->lease_time );
+			leased = true;
+			lazy_renewals.add();
 		}
 	}
 
-	// Find an IP address (prefer the one given, if any)
+	if ( !leased )
 	{
-		const uint8_t *hwaddr = p->chaddr;
-		std::vector<uint32_t> ips = getIPAddresses( hwaddr, true );
-		if ( ips.empty() )
+		leased = acquireLease( ip, hwaddr, block->lease_time );
+		for ( size_t i = 0; !leased && i < candidates.size(); ++i )
 		{
-			syslog( LOG_INFO, "Unable to offer an address to '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'",
-				hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
-			return;
+			if ( candidates[i] == ip || offerHeld( candidates[i], hwaddr ) )
+				continue;
+			lease_retries.add();
+			ip = candidates[i];
+			block = getOptionBlock( ip );
+			leased = acquireLease( ip, hwaddr, block->lease_time );
 		}
-		if ( std::find( ips.begin(), ips.end(), ip ) == ips.end() )
-			ip = ips[0];
 	}
+	releaseOffer( hwaddr );
 
-	// Create a reply packet
-	packet *reply = q.alloc();
-	memset( reply, 0, sizeof(packet) );
-	reply->op = BOOT_REPLY;
-	reply->htype = p->htype;
-	reply->hlen = p->hlen;
-	reply->xid = p->xid;
-	reply->yiaddr = ip;
-	memcpy( reply->chaddr, p->chaddr, p->hlen );
+	if ( leased )
+	{
+		buildReply( p, reply, ip, server_ip, DHCP_ACK, *block, prl, rapid );
+		if ( remaining > 0 && remaining != block->lease_time )
+			setLeaseTimes( reply, remaining, *block );
+	}
+	else
+	{
+		// Uhoh, not good.  Send a NAK
+		naks.add();
+		replyHeader( p, reply, ip );
+		std::vector<std::string> options;
+		options.push_back( format( "{0,n3}", char(53), char(1), char(DHCP_NAK) ) );
+		fillOptions( reply, options );
+	}
 
-	// Find the requested options
-	std::string lease;
-	std::string server;
+	udp_socket client( server_ip, 67, true );
+	client.send( INADDR_BROADCAST, 68, reply );
 
-	std::vector<std::string> options;
+	if ( leased )
 	{
-		// Get the options
-		std::vector<std::string> tmp;
-		getOptions( ip, tmp );
-
-		// Add the hostname
-		std::string hostname;
+		logMessage( LOG_INFO, LOGT_LEASE, "Leased %s to '%s'%s",
+				ip_string( reply->yiaddr ).c_str(),
+				mac_string( hwaddr ).c_str(), rapid ? " (rapid commit)" : "" );
+	}
+	else
+	{
+		logMessage( LOG_INFO, LOGT_LEASE, "Refused %s to '%s'",
+				ip_string( reply->yiaddr ).c_str(),
+				mac_string( hwaddr ).c_str() );
+	}
 
-		for ( std::string &o: tmp )
-		{
-			if ( o.empty() )
-				continue;
+	q.free( reply );
+}
 
-			if ( o[0] == DOP_HOSTNAME )
-			{
-				hostname = o;
-				continue;
-			}
+////////////////////////////////////////
 
-			if ( o[0] == DOP_IP_ADDRESS_LEASETIME )
-			{
-				lease = o;
-				continue;
-			}
+void replyDiscover( packet *p, packet_queue &q, uint32_t ip, uint32_t server_ip, const char *hostname, bool rapid )
+{
+	// Find the requested parameter list.
+	std::string prl = parameterList( p );
+	const uint8_t *hwaddr = p->chaddr;
 
-			if ( o[0] == DOP_SERVER_IDENTIFIER )
+	// Find an IP address (prefer the one given, if any) and hold it for the client
+	std::vector<uint32_t> ips;
+	{
+		if ( unknownClient( hwaddr ) )
+			ip = 0;
+		else if ( ip == 0 || !addressAvailable( ip, hwaddr ) || !reserveOffer( hwaddr, p->xid, ip ) )
+		{
+			ip = 0;
+			ips = getIPAddresses( hwaddr, true );
+			if ( ips.empty() )
+				noAddresses( hwaddr );
+			for ( uint32_t candidate: ips )
 			{
-				server = o;
-				continue;
+				if ( reserveOffer( hwaddr, p->xid, candidate ) )
+				{
+					ip = candidate;
+					break;
+				}
 			}
-
-			if ( requested.find( o[0] ) != requested.end() )
-				options.push_back( o );
 		}
-		
-		if ( hostname.empty() )
+
+		if ( ip == 0 )
 		{
-			try { hostname = ip_lookup( ip, false, false ); } catch ( ... ) {}
-			if ( !hostname.empty() )
-				options.push_back( format( "{0}{1}{2}", char(DOP_HOSTNAME), char(hostname.size()), hostname ) );
+			logMessage( LOG_INFO, LOGT_OFFER, "Unable to offer an address to '%s'",
+				mac_string( hwaddr ).c_str() );
+			return;
 		}
-		else
-			options.push_back( hostname );
-
-		std::sort( options.begin(), options.end() );
 	}
 
-	if ( server.empty() )
-	{
-		// Use the current server IP by default.
-		server.push_back( DOP_SERVER_IDENTIFIER );
-		server.push_back( 4 );
-		server.append( reinterpret_cast<const char*>( &server_ip ), 4 );
-	}
+	std::shared_ptr<const option_block> block = getOptionBlock( ip );
 
-	// Add mandatory options
-	uint32_t lease_time = 0;
-	if ( lease.size() == 6 )
+	// Skip the OFFER and REQUEST if both the client and the range allow it
+	if ( rapid && block->rapid_commit )
 	{
-		options.insert( options.begin(), lease );
-		for ( int i = 2; i < 6; ++i )
-			lease_time = ( lease_time << 8 ) + uint8_t(lease[i]);
+		rapid_transactions.add();
+		replyLease( p, q, ip, server_ip, block, prl, true, ips );
+		return;
 	}
-	options.insert( options.begin(), server );
 
-	bool leased = true;
-	if ( !acquireLease( ip, reply->chaddr, lease_time ) )
-	{
-		// Uhoh, not good.  Send a NAK
-		options.clear();
-		options.insert( options.begin(), format( "{0,n3}", char(53), char(1), char(DHCP_NAK) ) );
-		leased = false;
-	}
-	else
-		options.insert( options.begin(), format( "{0,n3}", char(53), char(1), char(DHCP_ACK) ) );
-
-	fillOptions( reply, options );
+	// Create a reply packet
+	packet *reply = q.alloc();
+	buildReply( p, reply, ip, server_ip, DHCP_OFFER, *block, prl, false );
 
+	// Send the packet
 	udp_socket client( server_ip, 67, true );
 	client.send( INADDR_BROADCAST, 68, reply );
 
-	uint8_t *hwaddr = reply->chaddr;
+	logMessage( LOG_INFO, LOGT_OFFER, "Offered %s to '%s'",
+		ip_string( reply->yiaddr ).c_str(), mac_string( hwaddr ).c_str() );
 
-	if ( leased )
+	q.free( reply );
+}
+
+////////////////////////////////////////
+
+void replyRequest( packet *p, packet_queue &q, uint32_t ip, uint32_t server_ip, const char *hostname )
+{
+	// Find the requested parameter list.
+	std::string prl = parameterList( p );
+	const uint8_t *hwaddr = p->chaddr;
+
+	// A renewing client only gives its current address in ciaddr.
+	if ( ip == 0 )
+		ip = p->ciaddr;
+
+	// Use the address we offered in this transaction, or the address
+	// we know the client has a lease on, or else find an IP address
+	// (prefer the one given, if any)
+	uint32_t offered = findOffer( hwaddr, p->xid );
+	std::vector<uint32_t> ips;
+	time_t expires = 0;
+	bool renewing = ( ip != 0 && cachedLease( ip, hwaddr, expires ) );
+	bool unknown = ( offered == 0 && !renewing && unknownClient( hwaddr ) );
+	if ( offered != 0 && ( ip == 0 || ip == offered ) )
 	{
-		syslog( LOG_INFO, "Leased %s to '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'",
-				ip_lookup( reply->yiaddr ).c_str(),
-				hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
+		four_message_transactions.add();
+		ip = offered;
 	}
-	else
+	else if ( !renewing && ( unknown || ip == 0 || offerHeld( ip, hwaddr ) || !addressAvailable( ip, hwaddr ) ) )
 	{
-		syslog( LOG_INFO, "Refused %s to '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'",
-				ip_lookup( reply->yiaddr ).c_str(),
-				hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
+		if ( !unknown )
+		{
+			ips = getIPAddresses( hwaddr, true );
+			if ( ips.empty() )
+				noAddresses( hwaddr );
+			ips.erase( std::remove_if( ips.begin(), ips.end(), [=]( uint32_t i ) { return offerHeld( i, hwaddr ); } ), ips.end() );
+		}
+		if ( ips.empty() )
+		{
+			logMessage( LOG_INFO, LOGT_OFFER, "Unable to offer an address to '%s'",
+				mac_string( hwaddr ).c_str() );
+			return;
+		}
+		ip = ips[0];
 	}
 
-	q.free( reply );
+	replyLease( p, q, ip, server_ip, getOptionBlock( ip ), prl, false, ips );
 }
 
 ////////////////////////////////////////
@@ -364,6 +455,7 @@ void handleClientRequest( packet *p, uint32_t server_addr, packet_queue &queue )
 	// Now process the options
 	enum MsgType type = DHCP_UNKNOWN;
 	uint32_t ipaddr = 0, server = 0;
+	bool rapid = false;
 
 	char hostname[1024] = { 0 };
 
@@ -381,7 +473,7 @@ void handleClientRequest( packet *p, uint32_t server_addr, packet_queue &queue )
 						type = MsgType(options[2]);
 					else
 					{
-						syslog( LOG_ERR, "Invalid DHCP message type length" );
+						logMessage( LOG_ERR, LOGT_ERROR, "Invalid DHCP message type length" );
 						return;
 					}
 					break;
@@ -391,7 +483,7 @@ void handleClientRequest( packet *p, uint32_t server_addr, packet_queue &queue )
 						memcpy( &ipaddr, &options[2], 4 );
 					else
 					{
-						syslog( LOG_ERR, "Invalid requested IP length" );
+						logMessage( LOG_ERR, LOGT_ERROR, "Invalid requested IP length" );
 						return;
 					}
 					break;
@@ -401,11 +493,15 @@ void handleClientRequest( packet *p, uint32_t server_addr, packet_queue &queue )
 						memcpy( &server, &options[2], 4 );
 					else
 					{
-						syslog( LOG_ERR, "Invalid server identifier length" );
+						logMessage( LOG_ERR, LOGT_ERROR, "Invalid server identifier length" );
 						return;
 					}
 					break;
 
+				case DOP_RAPID_COMMIT:
+					rapid = true;
+					break;
+
 				case DOP_HOSTNAME:
 				{
 					strncpy( hostname, reinterpret_cast<const char *>( options+2 ), uint32_t(options[1]) );
@@ -423,47 +519,47 @@ void handleClientRequest( packet *p, uint32_t server_addr, packet_queue &queue )
 		}
 	}
 	else
-		syslog( LOG_ERR, "Invalid DHCP magic cookie for options" );
+		logMessage( LOG_ERR, LOGT_ERROR, "Invalid DHCP magic cookie for options" );
 
 	uint8_t *hwaddr = p->chaddr;
 	switch ( type )
 	{
 		case DHCP_DISCOVER:
-			syslog( LOG_INFO, "Got DISCOVER from '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'", hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
-			replyDiscover( p, queue, ipaddr, server_addr, hostname );
+			logMessage( LOG_INFO, LOGT_DISCOVER, "Got DISCOVER from '%s'", mac_string( hwaddr ).c_str() );
+			replyDiscover( p, queue, ipaddr, server_addr, hostname, rapid );
 			break;
 
 		case DHCP_REQUEST:
 			if ( server == server_addr || server == INADDR_ANY )
 			{
-				syslog( LOG_INFO, "Got REQUEST from '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x' (for '%s' aka '%s')",
-					hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5], ip_lookup( ipaddr ).c_str(), hostname );
+				logMessage( LOG_INFO, LOGT_REQUEST, "Got REQUEST from '%s' (for '%s' aka '%s')",
+					mac_string( hwaddr ).c_str(), ip_string( ipaddr ).c_str(), hostname );
 				replyRequest( p, queue, ipaddr, server_addr, hostname );
 			}
 			else
 			{
-				syslog( LOG_INFO, "Ignore REQUEST for server %s from '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'",
-						ip_lookup( server ).c_str(), hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
+				logMessage( LOG_INFO, LOGT_REQUEST, "Ignore REQUEST for server %s from '%s'",
+						ip_string( server ).c_str(), mac_string( hwaddr ).c_str() );
 			}
 			break;
 
 		case DHCP_RELEASE:
-			syslog( LOG_INFO, "Got RELEASE from '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'", hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
+			logMessage( LOG_INFO, LOGT_RELEASE, "Got RELEASE from '%s'", mac_string( hwaddr ).c_str() );
 			if ( server == server_addr )
 			{
-				syslog( LOG_INFO, "Lease released from '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'", hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
+				logMessage( LOG_INFO, LOGT_RELEASE, "Lease released from '%s'", mac_string( hwaddr ).c_str() );
 				releaseLease( p->yiaddr, hwaddr );
 			}
 			else
-				syslog( LOG_INFO, "Ignoring release for server %s", ip_lookup( server ).c_str() );
+				logMessage( LOG_INFO, LOGT_RELEASE, "Ignoring release for server %s", ip_string( server ).c_str() );
 			break;
 
 		case DHCP_INFORM:
-			syslog( LOG_INFO, "Got INFORM from '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'", hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
+			logMessage( LOG_INFO, LOGT_INFORM, "Got INFORM from '%s'", mac_string( hwaddr ).c_str() );
 			break;
 
 		case DHCP_DECLINE:
-			syslog( LOG_INFO, "Got DECLINE from '%2.2x:%2.2x:%2.2x:%2.2x:%2.2x:%2.2x'", hwaddr[0], hwaddr[1], hwaddr[2], hwaddr[3], hwaddr[4], hwaddr[5] );
+			logMessage( LOG_INFO, LOGT_DECLINE, "Got DECLINE from '%s'", mac_string( hwaddr ).c_str() );
 			break;
 
 		default:
@@ -519,11 +615,11 @@ void handler( uint32_t server_addr, packet_queue &queue )
 				; // Ignore replies for now (always?)
 			}
 			else
-				syslog( LOG_ERR, "Invalid BOOTP op code" );
+				logMessage( LOG_ERR, LOGT_ERROR, "Invalid BOOTP op code" );
 		}
 		catch ( std::exception &e )
 		{
-			syslog( LOG_ERR, "Error processing packet: %s", e.what() );
+			logMessage( LOG_ERR, LOGT_ERROR, "Error processing packet: %s", e.what() );
 		}
 
 		queue.free( p );
@@ -0,0 +1,194 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "host_snapshot.h"
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+////////////////////////////////////////
+
+void host_snapshot::insertSorted( std::vector<uint32_t> &ips, uint32_t ip )
+{
+	auto i = std::lower_bound( ips.begin(), ips.end(), ip );
+	if ( i == ips.end() || *i != ip )
+		ips.insert( i, ip );
+}
+
+////////////////////////////////////////
+
+void host_snapshot::eraseSorted( std::vector<uint32_t> &ips, uint32_t ip )
+{
+	auto i = std::lower_bound( ips.begin(), ips.end(), ip );
+	if ( i != ips.end() && *i == ip )
+		ips.erase( i );
+}
+
+////////////////////////////////////////
+
+void host_snapshot::addHost( uint32_t ip, const std::string &mac )
+{
+	removeHost( ip );
+
+	uint32_t hip = ntohl( ip );
+	uint64_t m = pack_mac( reinterpret_cast<const uint8_t *>( mac.data() ) );
+	if ( m == 0 )
+		insertSorted( _dynamic, hip );
+	else
+		insertSorted( _by_mac[m], hip );
+	_by_ip[hip] = m;
+}
+
+////////////////////////////////////////
+
+void host_snapshot::removeHost( uint32_t ip )
+{
+	uint32_t hip = ntohl( ip );
+	const uint64_t *h = _by_ip.find( hip );
+	if ( h == NULL )
+		return;
+
+	uint64_t m = *h;
+	if ( m == 0 )
+		eraseSorted( _dynamic, hip );
+	else
+	{
+		std::vector<uint32_t> *ips = _by_mac.find( m );
+		eraseSorted( *ips, hip );
+		if ( ips->empty() )
+			_by_mac.erase( m );
+	}
+	_by_ip.erase( hip );
+}
+
+////////////////////////////////////////
+
+void host_snapshot::setOptions( const std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options )
+{
+	std::vector<option_range> rows;
+	for ( auto &o: options )
+		rows.push_back( { ntohl( std::get<0>( o ) ), ntohl( std::get<1>( o ) ), std::get<2>( o ) } );
+	_options.assign( std::move( rows ) );
+}
+
+////////////////////////////////////////
+
+void host_snapshot::replaceOptions( uint32_t from, const std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options )
+{
+	std::vector<option_range> rows;
+	for ( auto &o: options )
+		rows.push_back( { ntohl( std::get<0>( o ) ), ntohl( std::get<1>( o ) ), std::get<2>( o ) } );
+	_options.replace( ntohl( from ), rows );
+}
+
+////////////////////////////////////////
+
+void host_snapshot::setPools( const std::vector< std::pair<uint32_t, uint32_t> > &pools,
+	const std::vector< std::pair<uint32_t, uint32_t> > &exclusions )
+{
+	std::vector<address_range> p, e;
+	for ( auto &r: pools )
+		p.push_back( { ntohl( r.first ), ntohl( r.second ) } );
+	for ( auto &r: exclusions )
+		e.push_back( { ntohl( r.first ), ntohl( r.second ) } );
+	_pools = mergeRanges( p );
+	_exclusions = mergeRanges( e );
+}
+
+////////////////////////////////////////
+
+std::vector<address_range> host_snapshot::dynamicRanges( void ) const
+{
+	std::vector<address_range> ranges( _pools );
+	for ( uint32_t ip: _dynamic )
+		ranges.push_back( { ip, ip } );
+
+	std::vector<address_range> holes( _exclusions );
+	_by_ip.for_each( [&]( uint32_t ip, uint64_t mac )
+	{
+		if ( mac != 0 )
+			holes.push_back( { ip, ip } );
+	} );
+
+	return subtractRanges( mergeRanges( ranges ), mergeRanges( holes ) );
+}
+
+////////////////////////////////////////
+
+std::vector<uint64_t> host_snapshot::boundMACs( void ) const
+{
+	std::vector<uint64_t> ret;
+	ret.reserve( _by_mac.size() );
+	_by_mac.for_each( [&]( uint64_t mac, const std::vector<uint32_t> & ) { ret.push_back( mac ); } );
+	return ret;
+}
+
+////////////////////////////////////////
+
+std::vector<uint32_t> host_snapshot::getStaticAddresses( const uint8_t *mac ) const
+{
+	std::vector<uint32_t> ret;
+	uint64_t m = pack_mac( mac );
+	if ( m != 0 )
+	{
+		if ( const std::vector<uint32_t> *ips = _by_mac.find( m ) )
+		{
+			for ( uint32_t ip: *ips )
+				ret.push_back( htonl( ip ) );
+		}
+	}
+	return ret;
+}
+
+////////////////////////////////////////
+
+std::vector<uint32_t> host_snapshot::getIPAddresses( const uint8_t *mac ) const
+{
+	// The client's own addresses first, then the dynamic ones
+	std::vector<uint32_t> ret = getStaticAddresses( mac );
+	for ( uint32_t ip: _dynamic )
+		ret.push_back( htonl( ip ) );
+
+	return ret;
+}
+
+////////////////////////////////////////
+
+std::vector<std::string> host_snapshot::getMACAddresses( uint32_t ip ) const
+{
+	std::vector<std::string> ret;
+	if ( const uint64_t *h = _by_ip.find( ntohl( ip ) ) )
+		ret.push_back( unpack_mac( *h ) );
+	return ret;
+}
+
+////////////////////////////////////////
+
+void host_snapshot::getOptions( uint32_t ip, std::vector<std::string> &options ) const
+{
+	_options.lookup( ntohl( ip ), options );
+}
+
+////////////////////////////////////////
+
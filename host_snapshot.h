@@ -0,0 +1,91 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "address_pool.h"
+#include "flat_map.h"
+#include "option_table.h"
+
+////////////////////////////////////////
+
+// An in-memory copy of the hosts and options tables.
+// A snapshot is never changed once published: updates are made to a copy,
+// which then replaces the published snapshot.
+// Addresses are kept in host byte order and returned in network order.
+class host_snapshot
+{
+public:
+	// Add or remove the host with the given IP (network order).
+	void addHost( uint32_t ip, const std::string &mac );
+	void removeHost( uint32_t ip );
+
+	// Replace all of the dynamic pools and excluded ranges (network order).
+	void setPools( const std::vector< std::pair<uint32_t, uint32_t> > &pools,
+		const std::vector< std::pair<uint32_t, uint32_t> > &exclusions );
+
+	// Replace all of the options.
+	void setOptions( const std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options );
+
+	// Replace the options for the ranges starting at the IP (network order).
+	void replaceOptions( uint32_t from, const std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options );
+
+	// The same answers as the backend queries of the same name.
+	std::vector<uint32_t> getIPAddresses( const uint8_t *mac ) const;
+	std::vector<std::string> getMACAddresses( uint32_t ip ) const;
+
+	// Only the addresses set aside for the MAC address.
+	std::vector<uint32_t> getStaticAddresses( const uint8_t *mac ) const;
+	void getOptions( uint32_t ip, std::vector<std::string> &options ) const;
+
+	// The addresses any client can have: the pools and dynamic hosts,
+	// without the exclusions and the addresses of other hosts.
+	std::vector<address_range> dynamicRanges( void ) const;
+
+	// The MAC addresses (packed) with hosts set aside for them.
+	std::vector<uint64_t> boundMACs( void ) const;
+
+	size_t hosts( void ) const
+	{
+		return _by_ip.size();
+	}
+
+private:
+	static void insertSorted( std::vector<uint32_t> &ips, uint32_t ip );
+	static void eraseSorted( std::vector<uint32_t> &ips, uint32_t ip );
+
+	flat_map<uint64_t, std::vector<uint32_t> > _by_mac;
+	std::vector<uint32_t> _dynamic;
+	flat_map<uint32_t, uint64_t> _by_ip;
+	option_table _options;
+	std::vector<address_range> _pools;
+	std::vector<address_range> _exclusions;
+};
+
+////////////////////////////////////////
+
@@ -0,0 +1,242 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "hostname_cache.h"
+#include "lookup.h"
+#include "config.h"
+#include "strutils.h"
+
+#include <syslog.h>
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+namespace
+{
+	typedef std::chrono::steady_clock cache_clock;
+
+	struct cache_entry
+	{
+		std::string name;
+		cache_clock::time_point expires;
+		bool pending;
+	};
+
+	struct address_entry
+	{
+		uint32_t ip;
+		cache_clock::time_point expires;
+		bool pending;
+	};
+
+	std::mutex cache_mutex;
+	std::condition_variable cache_condition;
+	std::unordered_map<uint32_t,cache_entry> cache;
+	std::deque<uint32_t> lookups;
+
+	// Names resolved to addresses (for the TFTP server)
+	std::unordered_map<std::string,address_entry> addresses;
+	std::deque<std::string> address_lookups;
+
+	const size_t max_lookups = 4096;
+
+	std::once_flag started;
+
+	void refresh( void )
+	{
+		const std::chrono::seconds ttl( config_int( "hostname_ttl", 3600 ) );
+		const std::chrono::seconds negative_ttl( config_int( "hostname_negative_ttl", 300 ) );
+
+		const std::chrono::seconds address_ttl( config_int( "dns_cache_ttl", 300 ) );
+
+		while ( 1 )
+		{
+			uint32_t ip = 0;
+			std::string host;
+			{
+				std::unique_lock<std::mutex> lock( cache_mutex );
+				while ( lookups.empty() && address_lookups.empty() )
+					cache_condition.wait( lock );
+				if ( !address_lookups.empty() )
+				{
+					host = address_lookups.front();
+					address_lookups.pop_front();
+				}
+				else
+				{
+					ip = lookups.front();
+					lookups.pop_front();
+				}
+			}
+
+			if ( !host.empty() )
+			{
+				uint32_t addr = 0;
+				try { addr = dns_lookup( host.c_str() ); } catch ( ... ) {}
+
+				// Keep the last known address if the lookup failed
+				std::unique_lock<std::mutex> lock( cache_mutex );
+				address_entry &e = addresses[host];
+				if ( addr != 0 )
+					e.ip = addr;
+				e.expires = cache_clock::now() + ( addr == 0 ? negative_ttl : address_ttl );
+				e.pending = false;
+				continue;
+			}
+
+			std::string name;
+			try { name = ip_lookup( ip, false, false ); } catch ( ... ) {}
+
+			std::unique_lock<std::mutex> lock( cache_mutex );
+			cache_entry &e = cache[ip];
+			e.name = name;
+			e.expires = cache_clock::now() + ( name.empty() ? negative_ttl : ttl );
+			e.pending = false;
+		}
+	}
+
+	void start( void )
+	{
+		std::string hosts = configuration["hosts_file"];
+		if ( !hosts.empty() )
+			preloadHostnames( hosts );
+
+		std::thread( &refresh ).detach();
+	}
+
+	// Queue a lookup (with the cache locked).
+	void schedule( uint32_t ip, cache_entry &e )
+	{
+		if ( e.pending || lookups.size() >= max_lookups )
+			return;
+
+		e.pending = true;
+		lookups.push_back( ip );
+		cache_condition.notify_one();
+	}
+}
+
+////////////////////////////////////////
+
+bool cachedHostname( uint32_t ip, std::string &name )
+{
+	std::call_once( started, &start );
+
+	std::unique_lock<std::mutex> lock( cache_mutex );
+	auto e = cache.find( ip );
+	if ( e == cache.end() )
+	{
+		cache_entry &n = cache[ip];
+		n.pending = false;
+		schedule( ip, n );
+		return false;
+	}
+
+	// A stale name is still used while it is being refreshed.
+	if ( e->second.expires <= cache_clock::now() )
+		schedule( ip, e->second );
+
+	if ( e->second.expires == cache_clock::time_point() )
+		return false;
+
+	name = e->second.name;
+	return true;
+}
+
+////////////////////////////////////////
+
+bool cachedAddress( const std::string &name, uint32_t &ip )
+{
+	// A numeric address needs no lookup
+	if ( inet_pton( AF_INET, name.c_str(), &ip ) == 1 )
+		return true;
+
+	std::call_once( started, &start );
+
+	std::unique_lock<std::mutex> lock( cache_mutex );
+	auto i = addresses.find( name );
+	if ( i == addresses.end() )
+		i = addresses.emplace( name, address_entry { 0, cache_clock::time_point(), false } ).first;
+
+	address_entry &e = i->second;
+	if ( e.expires <= cache_clock::now() && !e.pending && address_lookups.size() < max_lookups )
+	{
+		e.pending = true;
+		address_lookups.push_back( name );
+		cache_condition.notify_one();
+	}
+
+	ip = e.ip;
+	return ip != 0;
+}
+
+////////////////////////////////////////
+
+void preloadHostnames( const std::string &file )
+{
+	std::ifstream in( file );
+	if ( !in )
+	{
+		syslog( LOG_ERR, "Unable to open hosts file %s", file.c_str() );
+		return;
+	}
+
+	size_t count = 0;
+	std::string line;
+	while ( std::getline( in, line ) )
+	{
+		line = trim( line.substr( 0, line.find_first_of( '#' ) ) );
+		if ( line.empty() )
+			continue;
+
+		std::stringstream str( line );
+		std::string addr, name;
+		str >> addr >> name;
+
+		uint32_t ip = 0;
+		if ( name.empty() || inet_pton( AF_INET, addr.c_str(), &ip ) != 1 )
+			continue;
+
+		// Only the short name is used for the hostname option.
+		name = name.substr( 0, name.find_first_of( '.' ) );
+
+		std::unique_lock<std::mutex> lock( cache_mutex );
+		cache_entry &e = cache[ip];
+		e.name = name;
+		e.expires = cache_clock::time_point::max();
+		e.pending = false;
+		++count;
+	}
+
+	syslog( LOG_INFO, "Loaded %lu hostnames from %s", static_cast<unsigned long>( count ), file.c_str() );
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,48 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+////////////////////////////////////////
+
+// Get the short hostname for the IP address without blocking.
+// Returns false if the name is not known yet, in which case it is
+// looked up in the background.  Addresses without a name are cached
+// as an empty name.
+bool cachedHostname( uint32_t ip, std::string &name );
+
+// Get the address of the name (network order) without blocking.
+// Returns false if the address is not known yet, in which case it is
+// looked up in the background.  A known address is still returned
+// while it is being refreshed.
+bool cachedAddress( const std::string &name, uint32_t &ip );
+
+// Add the names from a hosts-style file ("<ip> <name> [<alias> ...]").
+// These names never expire.
+void preloadHostnames( const std::string &file );
+
+////////////////////////////////////////
+
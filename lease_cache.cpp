@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "lease_cache.h"
+#include "address_pool.h"
+#include "flat_map.h"
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#include <mutex>
+
+namespace
+{
+	struct lease_entry
+	{
+		uint8_t mac[6];
+		time_t expires;
+	};
+
+	std::mutex lease_mutex;
+	flat_map<uint32_t,lease_entry> leases;
+	timer_wheel timers( time( NULL ) );
+}
+
+////////////////////////////////////////
+
+void rememberLease( uint32_t ip, const uint8_t *mac, time_t expires )
+{
+	std::unique_lock<std::mutex> lock( lease_mutex );
+	lease_entry &e = leases[ip];
+	memcpy( e.mac, mac, 6 );
+	e.expires = expires;
+	poolLease( ip, mac, expires );
+	timers.schedule( ip, expires );
+}
+
+////////////////////////////////////////
+
+bool cachedLease( uint32_t ip, const uint8_t *mac, time_t &expires )
+{
+	std::unique_lock<std::mutex> lock( lease_mutex );
+	lease_entry *l = leases.find( ip );
+	if ( l == NULL )
+		return false;
+
+	if ( l->expires <= time( NULL ) )
+	{
+		leases.erase( ip );
+		return false;
+	}
+
+	if ( memcmp( l->mac, mac, 6 ) != 0 )
+		return false;
+
+	expires = l->expires;
+	return true;
+}
+
+////////////////////////////////////////
+
+bool leaseHeld( uint32_t ip, const uint8_t *mac )
+{
+	std::unique_lock<std::mutex> lock( lease_mutex );
+	lease_entry *l = leases.find( ip );
+	if ( l == NULL )
+		return false;
+
+	if ( l->expires <= time( NULL ) )
+	{
+		leases.erase( ip );
+		return false;
+	}
+
+	return memcmp( l->mac, mac, 6 ) != 0;
+}
+
+////////////////////////////////////////
+
+void forgetLease( uint32_t ip )
+{
+	std::unique_lock<std::mutex> lock( lease_mutex );
+	leases.erase( ip );
+	poolRelease( ip );
+}
+
+////////////////////////////////////////
+
+void forEachLease( const std::function<void( uint32_t, const uint8_t *, time_t )> &f )
+{
+	time_t now = time( NULL );
+	std::unique_lock<std::mutex> lock( lease_mutex );
+	leases.for_each( [&]( uint32_t ip, const lease_entry &e )
+	{
+		if ( e.expires > now )
+			f( ip, e.mac, e.expires );
+	} );
+}
+
+////////////////////////////////////////
+
+void expireLeases( time_t now, std::vector<uint32_t> &expired )
+{
+	std::vector<uint64_t> due;
+
+	std::unique_lock<std::mutex> lock( lease_mutex );
+	timers.advance( now, due );
+	for ( uint64_t key: due )
+	{
+		// Renewed leases have a later timer.  Leases that are gone
+		// were released, or dropped once they had expired.
+		uint32_t ip = uint32_t( key );
+		lease_entry *l = leases.find( ip );
+		if ( l != NULL && l->expires > now )
+			continue;
+
+		leases.erase( ip );
+		poolRelease( ip );
+		expired.push_back( ip );
+	}
+}
+
+////////////////////////////////////////
+
+size_t leaseTimers( void )
+{
+	std::unique_lock<std::mutex> lock( lease_mutex );
+	return timers.size();
+}
+
+////////////////////////////////////////
@@ -0,0 +1,61 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+#include <functional>
+#include <vector>
+
+////////////////////////////////////////
+
+// The leases this server has granted, as last written to the backend.
+// With the in-memory snapshot, also every live lease in the database.
+
+// Remember that the lease on the IP was given to the MAC until expires.
+void rememberLease( uint32_t ip, const uint8_t *mac, time_t expires );
+
+// Get the expiration of the MAC's lease on the IP.
+// Returns false if no unexpired lease is known.
+bool cachedLease( uint32_t ip, const uint8_t *mac, time_t &expires );
+
+// Check if the IP has an unexpired lease to another MAC.
+bool leaseHeld( uint32_t ip, const uint8_t *mac );
+
+// Forget the lease on the IP.
+void forgetLease( uint32_t ip );
+
+// Call f( ip, mac, expires ) for each unexpired lease.
+void forEachLease( const std::function<void( uint32_t, const uint8_t *, time_t )> &f );
+
+// Forget the leases that expired by now, giving their addresses back to
+// the pools, and append the IPs so the rows can be deleted.
+void expireLeases( time_t now, std::vector<uint32_t> &expired );
+
+// The number of lease expirations being tracked.
+size_t leaseTimers( void );
+
+////////////////////////////////////////
+
@@ -0,0 +1,345 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "lease_journal.h"
+#include "error.h"
+#include "format.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+
+namespace
+{
+	const char journal_magic[8] = { 'D', 'H', 'C', 'P', 'J', 'R', 'N', 'L' };
+	const uint32_t journal_version = 1;
+
+	enum
+	{
+		OP_ACQUIRE = 1,
+		OP_RELEASE = 2,
+		OP_RELEASE_ANY = 3
+	};
+}
+
+////////////////////////////////////////
+
+struct lease_journal::header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t capacity;
+	uint64_t flushed;
+	uint8_t reserved[40];
+};
+
+struct lease_journal::record
+{
+	uint64_t serial;
+	int64_t stamp;
+	uint32_t ip;
+	uint32_t time;
+	uint8_t mac[6];
+	uint8_t op;
+	uint8_t reserved;
+	uint32_t check;
+	uint32_t reserved2;
+
+	uint32_t checksum( void ) const
+	{
+		// FNV-1a over everything before the check field
+		const uint8_t *b = reinterpret_cast<const uint8_t *>( this );
+		uint32_t h = 2166136261u;
+		for ( size_t i = 0; i < offsetof( record, check ); ++i )
+			h = ( h ^ b[i] ) * 16777619u;
+		return h;
+	}
+};
+
+////////////////////////////////////////
+
+lease_journal::lease_journal( const std::string &file, size_t capacity )
+	: _fd( -1 ), _capacity( capacity ), _size( 0 ), _header( NULL ), _records( NULL ),
+	  _next( 1 ), _durable( 0 ), _flushed( 0 ), _epoch( 0 ), _syncing( false )
+{
+	static_assert( sizeof(header) == 64, "journal header should be 64 bytes" );
+	static_assert( sizeof(record) == 40, "journal record should be 40 bytes" );
+
+	_fd = ::open( file.c_str(), O_RDWR | O_CREAT, 0600 );
+	if ( _fd < 0 )
+		error( errno, format( "Error opening lease journal {0}", file ) );
+
+	try
+	{
+		map( file );
+	}
+	catch ( ... )
+	{
+		::close( _fd );
+		throw;
+	}
+
+	if ( _durable > _flushed )
+		syslog( LOG_NOTICE, "Lease journal has %llu records to replay", static_cast<unsigned long long>( _durable - _flushed ) );
+}
+
+////////////////////////////////////////
+
+void lease_journal::map( const std::string &file )
+{
+	struct stat st;
+	if ( ::fstat( _fd, &st ) != 0 )
+		error( errno, "Error reading lease journal" );
+
+	// An existing journal keeps its size
+	bool existing = st.st_size >= off_t( sizeof(header) );
+	if ( existing )
+	{
+		header h;
+		if ( ::pread( _fd, &h, sizeof(h), 0 ) != ssize_t( sizeof(h) ) )
+			error( errno, "Error reading lease journal" );
+		if ( memcmp( h.magic, journal_magic, sizeof(journal_magic) ) != 0 || h.version != journal_version )
+			error( format( "Invalid lease journal {0}", file ) );
+		_capacity = h.capacity;
+	}
+
+	if ( _capacity == 0 )
+		error( "Lease journal has no capacity" );
+
+	_size = sizeof(header) + _capacity * sizeof(record);
+	if ( !existing && ::ftruncate( _fd, _size ) != 0 )
+		error( errno, "Error sizing lease journal" );
+
+	void *m = ::mmap( NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0 );
+	if ( m == MAP_FAILED )
+		error( errno, "Error mapping lease journal" );
+
+	_header = reinterpret_cast<header *>( m );
+	_records = reinterpret_cast<record *>( _header + 1 );
+
+	if ( !existing )
+	{
+		memset( _header, 0, sizeof(header) );
+		memcpy( _header->magic, journal_magic, sizeof(journal_magic) );
+		_header->version = journal_version;
+		_header->capacity = _capacity;
+		_header->flushed = 0;
+		if ( ::msync( _header, _size, MS_SYNC ) != 0 )
+			error( errno, "Error syncing lease journal" );
+	}
+
+	// Find the records that were never flushed
+	_flushed = _header->flushed;
+	_next = _flushed + 1;
+	while ( _next - _flushed <= _capacity )
+	{
+		record *r = slot( _next );
+		if ( r->serial != _next || r->check != r->checksum() )
+			break;
+		++_next;
+	}
+	_durable = _next - 1;
+}
+
+////////////////////////////////////////
+
+lease_journal::~lease_journal( void )
+{
+	::munmap( _header, _size );
+	::close( _fd );
+}
+
+////////////////////////////////////////
+
+lease_journal::record *lease_journal::slot( uint64_t serial )
+{
+	return _records + ( serial % _capacity );
+}
+
+////////////////////////////////////////
+
+bool lease_journal::sync( uint64_t first, uint64_t last )
+{
+	// Sync the pages holding the records (the ring may wrap around)
+	long page = ::sysconf( _SC_PAGESIZE );
+	for ( uint64_t s = first; s <= last; )
+	{
+		uint64_t end = std::min<uint64_t>( last, s + ( _capacity - s % _capacity ) - 1 );
+		uintptr_t b = reinterpret_cast<uintptr_t>( slot( s ) );
+		uintptr_t e = reinterpret_cast<uintptr_t>( slot( end ) + 1 );
+		b -= b % page;
+		if ( ::msync( reinterpret_cast<void *>( b ), e - b, MS_SYNC ) != 0 )
+		{
+			syslog( LOG_ERR, "Error syncing lease journal: %s", strerror( errno ) );
+			return false;
+		}
+		s = end + 1;
+	}
+	return true;
+}
+
+////////////////////////////////////////
+
+bool lease_journal::append( bool acquire, uint32_t ip, const uint8_t *mac, uint32_t time )
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	if ( _next - _flushed > _capacity )
+		return false;
+
+	uint64_t serial = _next++;
+	uint64_t epoch = _epoch;
+	record *r = slot( serial );
+	memset( r, 0, sizeof(record) );
+	r->serial = serial;
+	r->stamp = ::time( NULL );
+	r->ip = ip;
+	r->time = time;
+	if ( mac )
+		memcpy( r->mac, mac, 6 );
+	r->op = acquire ? OP_ACQUIRE : ( mac ? OP_RELEASE : OP_RELEASE_ANY );
+	r->check = r->checksum();
+
+	// Group sync: one thread syncs everything written so far while the
+	// others wait for it.  If the sync fails, every record not durable
+	// yet is dropped (a new epoch), and its append fails.
+	while ( _durable < serial )
+	{
+		if ( _epoch != epoch )
+			return false;
+
+		if ( _syncing )
+		{
+			_synced.wait( lock );
+			continue;
+		}
+
+		_syncing = true;
+		uint64_t first = _durable + 1;
+		uint64_t last = _next - 1;
+		lock.unlock();
+		bool synced = sync( first, last );
+		lock.lock();
+		if ( synced )
+			_durable = last;
+		else
+		{
+			for ( uint64_t s = first; s < _next; ++s )
+				memset( slot( s ), 0, sizeof(record) );
+			_next = first;
+			++_epoch;
+		}
+		_syncing = false;
+		_synced.notify_all();
+	}
+
+	_written.notify_one();
+	return true;
+}
+
+////////////////////////////////////////
+
+void lease_journal::pending( std::vector<journal_entry> &entries, size_t max )
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	while ( _durable <= _flushed )
+		_written.wait_for( lock, std::chrono::seconds( 1 ) );
+	collect( entries, max );
+}
+
+////////////////////////////////////////
+
+void lease_journal::unflushed( std::vector<journal_entry> &entries )
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	collect( entries, _capacity );
+}
+
+////////////////////////////////////////
+
+void lease_journal::collect( std::vector<journal_entry> &entries, size_t max )
+{
+	for ( uint64_t s = _flushed + 1; s <= _durable && entries.size() < max; ++s )
+	{
+		const record *r = slot( s );
+		journal_entry e;
+		e.serial = r->serial;
+		e.stamp = r->stamp;
+		e.ip = r->ip;
+		e.time = r->time;
+		memcpy( e.mac, r->mac, 6 );
+		e.acquire = ( r->op == OP_ACQUIRE );
+		e.any_mac = ( r->op == OP_RELEASE_ANY );
+		entries.push_back( e );
+	}
+}
+
+////////////////////////////////////////
+
+void lease_journal::flushed( uint64_t serial )
+{
+	{
+		std::unique_lock<std::mutex> lock( _mutex );
+		if ( serial <= _flushed )
+			return;
+		_header->flushed = std::max( _header->flushed, serial );
+	}
+
+	// The mark must be on disk before the slots up to it are reused: the
+	// records after an old mark would be lost once their slots are
+	// written over, as recovery stops at the first slot out of order.
+	if ( ::msync( _header, sizeof(header), MS_SYNC ) != 0 )
+	{
+		syslog( LOG_ERR, "Error syncing lease journal: %s", strerror( errno ) );
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock( _mutex );
+	_flushed = std::max( _flushed, serial );
+}
+
+////////////////////////////////////////
+
+uint64_t lease_journal::backlog( void )
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	return _durable - _flushed;
+}
+
+////////////////////////////////////////
+
+uint64_t lease_journal::last( void )
+{
+	std::unique_lock<std::mutex> lock( _mutex );
+	return _durable;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,107 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+////////////////////////////////////////
+
+// A lease change recorded in the journal.
+struct journal_entry
+{
+	uint64_t serial;
+	int64_t stamp;
+	uint32_t ip;
+	uint32_t time;
+	uint8_t mac[6];
+	bool acquire;
+	bool any_mac;
+};
+
+////////////////////////////////////////
+
+// Append-only journal of lease changes, kept in a memory-mapped file.
+// Records are written to a ring of fixed-size slots and are durable
+// (msync'ed, in batches) when append returns.  Records stay in the
+// journal until they are marked as flushed to the database, so records
+// left over from a crash are found again when the journal is opened.
+class lease_journal
+{
+public:
+	lease_journal( const std::string &file, size_t capacity );
+	~lease_journal( void );
+
+	// Record a lease change and wait until it is durable.
+	// Returns false if the journal is full or could not be synced.
+	bool append( bool acquire, uint32_t ip, const uint8_t *mac, uint32_t time );
+
+	// Wait for records that have not been flushed yet (up to max).
+	void pending( std::vector<journal_entry> &entries, size_t max );
+
+	// Get all the records that have not been flushed yet, without waiting.
+	void unflushed( std::vector<journal_entry> &entries );
+
+	// Mark all records up to and including serial as flushed.  The mark
+	// is synced before their slots can be used again.
+	void flushed( uint64_t serial );
+
+	// The number of records not flushed yet.
+	uint64_t backlog( void );
+
+	// The serial of the last durable record.
+	uint64_t last( void );
+
+private:
+	struct header;
+	struct record;
+
+	void map( const std::string &file );
+	record *slot( uint64_t serial );
+	bool sync( uint64_t first, uint64_t last );
+
+	// With the lock held: append the durable records not flushed yet.
+	void collect( std::vector<journal_entry> &entries, size_t max );
+
+	int _fd;
+	size_t _capacity;
+	size_t _size;
+	header *_header;
+	record *_records;
+
+	std::mutex _mutex;
+	std::condition_variable _written;
+	std::condition_variable _synced;
+	uint64_t _next;
+	uint64_t _durable;
+	uint64_t _flushed;
+	uint64_t _epoch;
+	bool _syncing;
+};
+
+////////////////////////////////////////
+
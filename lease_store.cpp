@@ -0,0 +1,439 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#include "lease_store.h"
+#include "address_pool.h"
+#include "error.h"
+#include "format.h"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace
+{
+	const char store_magic[8] = { 'D', 'H', 'C', 'P', 'L', 'S', 'T', 'R' };
+	const uint32_t store_version = 1;
+
+	// Log records replayed between syncs of the records
+	const size_t replay_batch = 4096;
+}
+
+////////////////////////////////////////
+
+struct lease_store::header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t network;
+	uint32_t count;
+	uint8_t reserved[44];
+};
+
+// A free record has expires 0.
+struct lease_store::record
+{
+	int64_t expires;
+	uint8_t mac[6];
+	uint8_t reserved[2];
+};
+
+////////////////////////////////////////
+
+lease_store::lease_store( const std::string &file, uint32_t network, int prefix, size_t log_size )
+	: _fd( -1 ), _network( 0 ), _count( 0 ), _size( 0 ), _header( NULL ), _records( NULL ), _leases( 0 )
+{
+	static_assert( sizeof(header) == 64, "lease store header should be 64 bytes" );
+	static_assert( sizeof(record) == 16, "lease store record should be 16 bytes" );
+
+	if ( prefix < 8 || prefix > 32 )
+		error( format( "Invalid lease store prefix /{0}", prefix ) );
+	_count = uint32_t( 1 ) << ( 32 - prefix );
+	_network = ntohl( network ) & ~( _count - 1 );
+
+	_fd = ::open( file.c_str(), O_RDWR | O_CREAT, 0600 );
+	if ( _fd < 0 )
+		error( errno, format( "Error opening lease store {0}", file ) );
+
+	// Only one process may have the store (and its log) open
+	if ( ::flock( _fd, LOCK_EX | LOCK_NB ) != 0 )
+	{
+		int err = errno;
+		::close( _fd );
+		if ( err == EWOULDBLOCK )
+			error( format( "Lease store {0} is in use by another process (is the server running?)", file ) );
+		error( err, format( "Error locking lease store {0}", file ) );
+	}
+
+	try
+	{
+		map( file );
+		_log.reset( new lease_journal( file + ".log", log_size ) );
+	}
+	catch ( ... )
+	{
+		if ( _header )
+			::munmap( _header, _size );
+		::close( _fd );
+		throw;
+	}
+
+	replay();
+}
+
+////////////////////////////////////////
+
+lease_store::~lease_store( void )
+{
+	checkpoint();
+	_log.reset();
+	::munmap( _header, _size );
+	::close( _fd );
+}
+
+////////////////////////////////////////
+
+void lease_store::map( const std::string &file )
+{
+	struct stat st;
+	if ( ::fstat( _fd, &st ) != 0 )
+		error( errno, "Error reading lease store" );
+
+	// An existing store must be for the same network
+	bool existing = st.st_size >= off_t( sizeof(header) );
+	if ( existing )
+	{
+		header h;
+		if ( ::pread( _fd, &h, sizeof(h), 0 ) != ssize_t( sizeof(h) ) )
+			error( errno, "Error reading lease store" );
+		if ( memcmp( h.magic, store_magic, sizeof(store_magic) ) != 0 || h.version != store_version )
+			error( format( "Invalid lease store {0}", file ) );
+		if ( h.network != _network || h.count != _count )
+			error( format( "Lease store {0} is for another network", file ) );
+	}
+
+	_size = sizeof(header) + size_t( _count ) * sizeof(record);
+	if ( !existing && ::ftruncate( _fd, _size ) != 0 )
+		error( errno, "Error sizing lease store" );
+
+	void *m = ::mmap( NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0 );
+	if ( m == MAP_FAILED )
+		error( errno, "Error mapping lease store" );
+
+	_header = reinterpret_cast<header *>( m );
+	_records = reinterpret_cast<record *>( _header + 1 );
+
+	if ( !existing )
+	{
+		memset( _header, 0, sizeof(header) );
+		memcpy( _header->magic, store_magic, sizeof(store_magic) );
+		_header->version = store_version;
+		_header->network = _network;
+		_header->count = _count;
+		if ( ::msync( _header, sizeof(header), MS_SYNC ) != 0 )
+			error( errno, "Error syncing lease store" );
+	}
+}
+
+////////////////////////////////////////
+
+void lease_store::replay( void )
+{
+	// Apply the changes logged since the last checkpoint
+	size_t replayed = 0;
+	while ( _log->backlog() > 0 )
+	{
+		std::vector<journal_entry> entries;
+		_log->pending( entries, replay_batch );
+		for ( const journal_entry &e: entries )
+			apply( e );
+		replayed += entries.size();
+
+		if ( ::msync( _header, _size, MS_SYNC ) != 0 )
+			error( errno, "Error syncing lease store" );
+		_log->flushed( entries.back().serial );
+	}
+	if ( replayed > 0 )
+		syslog( LOG_NOTICE, "Replayed %zu lease changes", replayed );
+
+	// Index the unexpired leases
+	time_t now = ::time( NULL );
+	for ( uint32_t i = 0; i < _count; ++i )
+	{
+		const record &r = _records[i];
+		if ( r.expires > now )
+			index( r.mac, htonl( _network + i ), true );
+		if ( r.expires != 0 )
+			++_leases;
+	}
+}
+
+////////////////////////////////////////
+
+void lease_store::apply( const journal_entry &e )
+{
+	record *r = find( e.ip );
+	if ( r == NULL )
+		return;
+
+	if ( e.acquire )
+	{
+		memcpy( r->mac, e.mac, 6 );
+		r->expires = e.stamp + e.time;
+	}
+	else if ( e.any_mac || memcmp( r->mac, e.mac, 6 ) == 0 )
+		memset( r, 0, sizeof(record) );
+}
+
+////////////////////////////////////////
+
+lease_store::record *lease_store::find( uint32_t ip ) const
+{
+	uint32_t offset = ntohl( ip ) - _network;
+	return offset < _count ? _records + offset : NULL;
+}
+
+////////////////////////////////////////
+
+bool lease_store::covers( uint32_t ip ) const
+{
+	return find( ip ) != NULL;
+}
+
+////////////////////////////////////////
+
+lease_store::mac_stripe &lease_store::stripeFor( const uint8_t *mac )
+{
+	return _macs[macHash( mac ) % stripes];
+}
+
+////////////////////////////////////////
+
+void lease_store::index( const uint8_t *mac, uint32_t ip, bool add )
+{
+	mac_stripe &s = stripeFor( mac );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	if ( add )
+		s.leases[pack_mac( mac )] = ip;
+	else
+	{
+		const uint32_t *i = s.leases.find( pack_mac( mac ) );
+		if ( i != NULL && *i == ip )
+			s.leases.erase( pack_mac( mac ) );
+	}
+}
+
+////////////////////////////////////////
+
+bool lease_store::logged( bool acquire, uint32_t ip, const uint8_t *mac, uint32_t time )
+{
+	if ( _log->append( acquire, ip, mac, time ) )
+		return true;
+
+	// The log is full: make room with a checkpoint
+	checkpoint();
+	return _log->append( acquire, ip, mac, time );
+}
+
+////////////////////////////////////////
+
+bool lease_store::acquire( uint32_t ip, const uint8_t *mac, uint32_t time, time_t &expires )
+{
+	record *r = find( ip );
+	if ( r == NULL )
+		return false;
+
+	time_t now = ::time( NULL );
+
+	stripe &s = stripeFor( ip );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	if ( r->expires > now && memcmp( r->mac, mac, 6 ) != 0 )
+		return false;
+
+	// The record is written before the log, so a checkpoint syncs every
+	// change that is in the log
+	record old = *r;
+	memcpy( r->mac, mac, 6 );
+	r->expires = now + time;
+	if ( !logged( true, ip, mac, time ) )
+	{
+		*r = old;
+		return false;
+	}
+	expires = r->expires;
+	lock.unlock();
+
+	if ( old.expires == 0 )
+		++_leases;
+	else if ( memcmp( old.mac, mac, 6 ) != 0 )
+		index( old.mac, ip, false );
+	index( mac, ip, true );
+	return true;
+}
+
+////////////////////////////////////////
+
+bool lease_store::release( uint32_t ip, const uint8_t *mac )
+{
+	record *r = find( ip );
+	if ( r == NULL )
+		return false;
+
+	stripe &s = stripeFor( ip );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	if ( r->expires == 0 || ( mac && memcmp( r->mac, mac, 6 ) != 0 ) )
+		return false;
+
+	record old = *r;
+	memset( r, 0, sizeof(record) );
+	if ( !logged( false, ip, mac, 0 ) )
+	{
+		*r = old;
+		return false;
+	}
+	lock.unlock();
+
+	--_leases;
+	index( old.mac, ip, false );
+	return true;
+}
+
+////////////////////////////////////////
+
+bool lease_store::held( uint32_t ip, const uint8_t *mac )
+{
+	record *r = find( ip );
+	if ( r == NULL )
+		return false;
+
+	stripe &s = stripeFor( ip );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	return r->expires > ::time( NULL ) && memcmp( r->mac, mac, 6 ) != 0;
+}
+
+////////////////////////////////////////
+
+uint32_t lease_store::leased( const uint8_t *mac )
+{
+	uint32_t ip = 0;
+	{
+		mac_stripe &s = stripeFor( mac );
+		std::unique_lock<std::mutex> lock( s.mutex );
+		const uint32_t *i = s.leases.find( pack_mac( mac ) );
+		if ( i == NULL )
+			return 0;
+		ip = *i;
+	}
+
+	// The index may be behind the record
+	record *r = find( ip );
+	stripe &s = stripeFor( ip );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	if ( r->expires > ::time( NULL ) && memcmp( r->mac, mac, 6 ) == 0 )
+		return ip;
+	return 0;
+}
+
+////////////////////////////////////////
+
+size_t lease_store::expire( const std::vector<uint32_t> &ips, time_t now )
+{
+	// Expired leases are cleared without logging them: after a crash an
+	// expired record is free anyway
+	size_t count = 0;
+	for ( uint32_t ip: ips )
+	{
+		record *r = find( ip );
+		if ( r == NULL )
+			continue;
+
+		uint8_t mac[6];
+		{
+			stripe &s = stripeFor( ip );
+			std::unique_lock<std::mutex> lock( s.mutex );
+			if ( r->expires == 0 || r->expires > now )
+				continue;
+			memcpy( mac, r->mac, 6 );
+			memset( r, 0, sizeof(record) );
+		}
+
+		--_leases;
+		index( mac, ip, false );
+		++count;
+	}
+	return count;
+}
+
+////////////////////////////////////////
+
+void lease_store::forEach( const std::function<void( uint32_t, const uint8_t *, time_t )> &f )
+{
+	time_t now = ::time( NULL );
+	for ( uint32_t i = 0; i < _count; ++i )
+	{
+		uint32_t ip = htonl( _network + i );
+		record r;
+		{
+			stripe &s = stripeFor( ip );
+			std::unique_lock<std::mutex> lock( s.mutex );
+			r = _records[i];
+		}
+		if ( r.expires > now )
+			f( ip, r.mac, r.expires );
+	}
+}
+
+////////////////////////////////////////
+
+void lease_store::checkpoint( void )
+{
+	std::unique_lock<std::mutex> lock( _checkpoint_mutex );
+	if ( _log->backlog() == 0 )
+		return;
+
+	// Every record change logged up to serial was made before it was
+	// logged, so syncing the records now makes them durable
+	uint64_t serial = _log->last();
+	if ( ::msync( _header, _size, MS_SYNC ) != 0 )
+	{
+		syslog( LOG_ERR, "Error syncing lease store: %s", strerror( errno ) );
+		return;
+	}
+	_log->flushed( serial );
+}
+
+////////////////////////////////////////
+
+size_t lease_store::size( void )
+{
+	return _leases;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,228 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "log.h"
+#include "config.h"
+#include "stats.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <syslog.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	const size_t ring_size = 1024;
+	const size_t message_size = 240;
+
+	const char *type_names[LOGT_COUNT] =
+	{
+		"general",
+		"discover",
+		"offer",
+		"request",
+		"lease",
+		"release",
+		"inform",
+		"decline",
+		"error",
+	};
+
+	struct log_entry
+	{
+		int priority;
+		char message[message_size];
+	};
+
+	// Single producer (the owning thread), single consumer (the writer).
+	struct log_ring
+	{
+		log_ring( void ) : head( 0 ), tail( 0 ) {}
+
+		std::atomic<size_t> head;
+		std::atomic<size_t> tail;
+		log_entry entries[ring_size];
+	};
+
+	std::atomic<bool> started( false );
+	uint32_t rate_limit = 100;
+
+	std::mutex rings_mutex;
+	std::vector<std::shared_ptr<log_ring>> rings;
+
+	std::atomic<uint32_t> counts[LOGT_COUNT];
+
+	stat_counter dropped( "log_dropped" );
+	stat_counter suppressed( "log_suppressed" );
+
+	log_ring &threadRing( void )
+	{
+		thread_local std::shared_ptr<log_ring> ring;
+		if ( !ring )
+		{
+			ring = std::make_shared<log_ring>();
+			std::unique_lock<std::mutex> lock( rings_mutex );
+			rings.push_back( ring );
+		}
+		return *ring;
+	}
+
+	size_t drain( void )
+	{
+		std::vector<std::shared_ptr<log_ring>> all;
+		{
+			std::unique_lock<std::mutex> lock( rings_mutex );
+			all = rings;
+		}
+
+		size_t n = 0;
+		for ( auto &r: all )
+		{
+			size_t head = r->head.load( std::memory_order_relaxed );
+			size_t tail = r->tail.load( std::memory_order_acquire );
+			for ( ; head != tail; ++head, ++n )
+			{
+				log_entry &e = r->entries[head % ring_size];
+				syslog( e.priority, "%s", e.message );
+			}
+			r->head.store( head, std::memory_order_release );
+		}
+		return n;
+	}
+
+	void summarize( uint64_t &last_dropped )
+	{
+		for ( int t = 0; t < LOGT_COUNT; ++t )
+		{
+			uint32_t n = counts[t].exchange( 0 );
+			if ( n > rate_limit )
+			{
+				syslog( LOG_NOTICE, "%u %s messages suppressed", n - rate_limit, type_names[t] );
+				suppressed.add( n - rate_limit );
+			}
+		}
+
+		uint64_t d = dropped.value();
+		if ( d != last_dropped )
+		{
+			syslog( LOG_NOTICE, "%llu messages dropped (log queue full)", static_cast<unsigned long long>( d - last_dropped ) );
+			last_dropped = d;
+		}
+	}
+
+	void writer( void )
+	{
+		typedef std::chrono::steady_clock log_clock;
+
+		uint64_t last_dropped = 0;
+		log_clock::time_point window = log_clock::now() + std::chrono::seconds( 1 );
+		while ( 1 )
+		{
+			if ( drain() == 0 )
+				std::this_thread::sleep_for( std::chrono::milliseconds( 5 ) );
+
+			if ( log_clock::now() >= window )
+			{
+				summarize( last_dropped );
+				window = log_clock::now() + std::chrono::seconds( 1 );
+			}
+		}
+	}
+}
+
+////////////////////////////////////////
+
+void startLogging( void )
+{
+	static std::once_flag once;
+	std::call_once( once, []()
+	{
+		rate_limit = config_int( "log_rate", 100 );
+		std::thread( &writer ).detach();
+		started.store( true, std::memory_order_release );
+	} );
+}
+
+////////////////////////////////////////
+
+void logMessage( int priority, LogType type, const char *fmt, ... )
+{
+	va_list args;
+	va_start( args, fmt );
+
+	if ( !started.load( std::memory_order_acquire ) )
+	{
+		vsyslog( priority, fmt, args );
+		va_end( args );
+		return;
+	}
+
+	// Rate limit (the writer reports and resets the counts every second).
+	if ( counts[type].fetch_add( 1, std::memory_order_relaxed ) >= rate_limit )
+	{
+		va_end( args );
+		return;
+	}
+
+	log_ring &r = threadRing();
+	size_t tail = r.tail.load( std::memory_order_relaxed );
+	if ( tail - r.head.load( std::memory_order_acquire ) >= ring_size )
+	{
+		dropped.add();
+		va_end( args );
+		return;
+	}
+
+	log_entry &e = r.entries[tail % ring_size];
+	e.priority = priority;
+	vsnprintf( e.message, message_size, fmt, args );
+	va_end( args );
+
+	r.tail.store( tail + 1, std::memory_order_release );
+}
+
+////////////////////////////////////////
+
+mac_string::mac_string( const uint8_t *mac )
+{
+	static const char hex[] = "0123456789abcdef";
+
+	char *s = _str;
+	for ( int i = 0; i < 6; ++i )
+	{
+		if ( i > 0 )
+			*s++ = ':';
+		*s++ = hex[mac[i] >> 4];
+		*s++ = hex[mac[i] & 0xF];
+	}
+	*s = '\0';
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,71 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+
+////////////////////////////////////////
+
+// Message categories, each one rate limited separately.
+enum LogType
+{
+	LOGT_GENERAL,
+	LOGT_DISCOVER,
+	LOGT_OFFER,
+	LOGT_REQUEST,
+	LOGT_LEASE,
+	LOGT_RELEASE,
+	LOGT_INFORM,
+	LOGT_DECLINE,
+	LOGT_ERROR,
+
+	LOGT_COUNT
+};
+
+// Start the background thread writing to syslog.
+// Until this is called, messages are written to syslog directly.
+void startLogging( void );
+
+// Queue a message for syslog.
+// This never blocks: messages are dropped when the queue of the calling
+// thread is full or when more than log_rate messages of the type were
+// logged in the current second.  Drops are summarized in the log.
+void logMessage( int priority, LogType type, const char *fmt, ... ) __attribute__(( format( printf, 3, 4 ) ));
+
+////////////////////////////////////////
+
+// Format a MAC address (00:11:22:33:44:55) without going through printf.
+class mac_string
+{
+public:
+	explicit mac_string( const uint8_t *mac );
+
+	const char *c_str( void ) const { return _str; }
+
+private:
+	char _str[18];
+};
+
+////////////////////////////////////////
+
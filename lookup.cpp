@@ -21,6 +21,7 @@
 //
 
 #include "lookup.h"
+#include "config.h"
 #include "error.h"
 
 #include <unistd.h>
@@ -33,50 +34,99 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
+#include <chrono>
 #include <exception>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
-////////////////////////////////////////
-
-uint32_t dns_lookup( const char *name )
+namespace
 {
-	uint32_t ret = 0;
+	// Give up on a temporary resolver failure after this many attempts.
+	const int max_tries = 3;
 
-	// Try a numeric address first.
-	if ( inet_pton( AF_INET, name, &ret ) == 1 )
-		return ret;
+	// Failed lookups are remembered for a short while.
+	const std::chrono::seconds negative_ttl( 30 );
 
-	struct addrinfo *res0 = NULL;
-	int err = EAI_AGAIN;
-	struct addrinfo hints;
+	typedef std::chrono::steady_clock cache_clock;
 
-	memset( &hints, 0, sizeof(hints) );
-	hints.ai_family = AF_INET;
+	struct cache_entry
+	{
+		uint32_t ip;
+		cache_clock::time_point expires;
+	};
 
-	while ( err == EAI_AGAIN )
-		err = getaddrinfo( name, NULL, &hints, &res0 );
+	std::mutex cache_mutex;
+	std::unordered_map<std::string,cache_entry> cache;
 
-	if ( err == 0 )
+	// Resolve the name, returning 0 if that failed.
+	uint32_t resolve( const char *name )
 	{
-		struct addrinfo *res = res0;
-		for ( ; res; res=res->ai_next )
+		struct addrinfo *res0 = NULL;
+		int err = EAI_AGAIN;
+		struct addrinfo hints;
+
+		memset( &hints, 0, sizeof(hints) );
+		hints.ai_family = AF_INET;
+
+		for ( int tries = 0; err == EAI_AGAIN && tries < max_tries; ++tries )
+		{
+			if ( tries > 0 )
+				std::this_thread::sleep_for( std::chrono::milliseconds( 10 * tries ) );
+			err = getaddrinfo( name, NULL, &hints, &res0 );
+		}
+
+		if ( err != 0 )
+			return 0;
+
+		uint32_t ret = 0;
+		for ( struct addrinfo *res = res0; res; res=res->ai_next )
 		{
 			if ( res->ai_addrlen == sizeof(struct sockaddr_in) )
+			{
+				struct sockaddr_in *a = (struct sockaddr_in *)( res->ai_addr );
+				ret = a->sin_addr.s_addr;
 				break;
+			}
 		}
 
-		if ( res )
+		freeaddrinfo( res0 );
+		return ret;
+	}
+}
+
+////////////////////////////////////////
+
+uint32_t dns_lookup( const char *name )
+{
+	uint32_t ret = 0;
+
+	// Try a numeric address first.
+	if ( inet_pton( AF_INET, name, &ret ) == 1 )
+		return ret;
+
+	static const std::chrono::seconds ttl( config_int( "dns_cache_ttl", 300 ) );
+
+	cache_clock::time_point now = cache_clock::now();
+	bool cached = false;
+	{
+		std::unique_lock<std::mutex> lock( cache_mutex );
+		auto e = cache.find( name );
+		if ( e != cache.end() && e->second.expires > now )
 		{
-			struct sockaddr_in *a = (struct sockaddr_in *)( res->ai_addr );
-			ret = a->sin_addr.s_addr;
+			ret = e->second.ip;
+			cached = true;
 		}
+	}
 
-		freeaddrinfo( res0 );
+	if ( !cached )
+	{
+		ret = resolve( name );
 
-		if ( !res )
-			error( std::string( "Name lookup failed " ) + name );
+		std::unique_lock<std::mutex> lock( cache_mutex );
+		cache[name] = cache_entry { ret, now + ( ret == 0 ? std::min( ttl, negative_ttl ) : ttl ) };
 	}
-	else
-		error( std::string( "Name lookup failed " ) + name );
 
 	if ( ret == 0 )
 		error( std::string( "Name lookup failed " ) + name );
@@ -106,8 +156,8 @@ std::string ip_lookup( uint32_t ip, bool numeric, bool fqdn )
 		flags |= NI_NAMEREQD;
 	if ( !fqdn )
 		flags |= NI_NOFQDN;
-	while ( err == EAI_AGAIN )
-		err = getnameinfo( (struct sockaddr*)&sa, sizeof(sa), node, sizeof(node), NULL, 0, NI_NOFQDN );
+	for ( int tries = 0; err == EAI_AGAIN && tries < max_tries; ++tries )
+		err = getnameinfo( (struct sockaddr*)&sa, sizeof(sa), node, sizeof(node), NULL, 0, flags );
 
 	if ( err != 0 )
 	{
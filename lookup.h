@@ -28,6 +28,7 @@
 ////////////////////////////////////////
 
 // Lookup name and return IP address.
+// Results (and failures) are cached for a while.
 uint32_t dns_lookup( const char *name );
 
 // Lookup IP address and return name.
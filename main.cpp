@@ -39,6 +39,11 @@ void print_usage( const std::string &prog )
 	std::cout << "  add-host <ip> <mac> - add option for IP range\n";
 	std::cout << "  replace-host <ip> [<new_ip>] <mac> - replace the given IP with a new MAC (and IP) address\n";
 	std::cout << "  remove-host <ip> - remove a host with a IP address\n";
+	std::cout << "  pools - list the dynamic address pools and exclusions\n";
+	std::cout << "  add-pool <ip> <ip> - add a range of addresses for any client\n";
+	std::cout << "  remove-pool <ip> <ip> - remove a range of addresses for any client\n";
+	std::cout << "  add-exclusion <ip> <ip> - exclude a range of addresses from the pools\n";
+	std::cout << "  remove-exclusion <ip> <ip> - remove an excluded range\n";
 	std::cout << "  leases - list all leases\n";
 	std::cout << "  release-lease <ip> ... - release the lease for IP address(es)\n";
 	std::cout << "  list-all [<mac>] - list IP addresses (for a MAC address)\n";
@@ -47,6 +52,7 @@ void print_usage( const std::string &prog )
 	std::cout << "  decode <hex> ... - decode the hex option into something readable\n";
 	std::cout << "  discover <ip> <mac> [<option> ...] - send a discover packet to an IP address\n";
 	std::cout << "  monitor - listen for DHCP packets and show them\n";
+	std::cout << "  migrate - upgrade the database schema to the current version\n";
 	std::cout << "\nDHCP Options:\n";
 
 	for ( auto opt: dhcp_options )
@@ -129,6 +135,9 @@ int safemain( int argc, char *argv[] )
 			command.push_back( std::string() );
 
 		threadStartBackend();
+		int version = schemaVersion();
+		if ( version != schema_version )
+			error( format( "Database schema is version {0} (need {1}), run 'migrate' first", version, schema_version ) );
 		int ret = server( command[1] );
 		threadStopBackend();
 	}
@@ -174,6 +183,22 @@ int safemain( int argc, char *argv[] )
 				std::cout << format( "{0}\t{1}\t{2}", ip_string( std::get<0>( opt ) ), ip_string( std::get<1>( opt ) ), print_options( std::get<2>( opt ) ) ) << std::endl;
 		}
 	}
+	else if ( command[0] == "migrate" )
+	{
+		threadStartBackend();
+		if ( command.size() != 1 )
+			error( "Command 'migrate' needs no argument: migrate" );
+
+		int version = schemaVersion();
+		if ( version < schema_version )
+		{
+			migrateSchema();
+			std::cout << format( "Migrated schema from version {0} to {1}", version, schema_version ) << std::endl;
+		}
+		else
+			std::cout << format( "Schema is already version {0}", version ) << std::endl;
+		threadStopBackend();
+	}
 	else if ( command[0] == "add-option" || command[0] == "replace-option" )
 	{
 		threadStartBackend();
@@ -260,6 +285,38 @@ int safemain( int argc, char *argv[] )
 		removeHost( ip );
 		threadStopBackend();
 	}
+	else if ( command[0] == "pools" )
+	{
+		threadStartBackend();
+		if ( command.size() != 1 )
+			error( "Command 'pools' needs no argument: pools" );
+
+		std::vector< std::pair<uint32_t, uint32_t> > pools, exclusions;
+		getAllPools( pools, exclusions );
+		for ( auto p: pools )
+			std::cout << format( "pool\t{0}\t{1}", ip_string( p.first ), ip_string( p.second ) ) << std::endl;
+		for ( auto e: exclusions )
+			std::cout << format( "exclude\t{0}\t{1}", ip_string( e.first ), ip_string( e.second ) ) << std::endl;
+		threadStopBackend();
+	}
+	else if ( command[0] == "add-pool" || command[0] == "remove-pool" || command[0] == "add-exclusion" || command[0] == "remove-exclusion" )
+	{
+		threadStartBackend();
+		if ( command.size() != 3 )
+			error( format( "Command '{0}' needs 2 arguments: {0} <ip> <ip>", command[0] ) );
+
+		uint32_t ip1 = dns_lookup( command[1].c_str() );
+		uint32_t ip2 = dns_lookup( command[2].c_str() );
+		if ( ntohl( ip1 ) > ntohl( ip2 ) )
+			std::swap( ip1, ip2 );
+
+		bool exclusion = ( command[0].find( "exclusion" ) != std::string::npos );
+		if ( command[0].compare( 0, 4, "add-" ) == 0 )
+			addPool( ip1, ip2, exclusion );
+		else
+			removePool( ip1, ip2, exclusion );
+		threadStopBackend();
+	}
 	else if ( command[0] == "leases" )
 	{
 		threadStartBackend();
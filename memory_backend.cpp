@@ -0,0 +1,491 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#include "memory_backend.h"
+#include "address_pool.h"
+#include "client_filter.h"
+#include "config.h"
+#include "error.h"
+#include "lease_cache.h"
+#include "lookup.h"
+#include "offer_table.h"
+#include "option_cache.h"
+#include "stats.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+	// Free dynamic addresses returned for a client to choose from
+	const size_t free_candidates = 8;
+
+	stat_counter memory_leases( "memory_leases" );
+	stat_counter memory_expired( "memory_leases_expired" );
+
+	std::string hex( const std::string &s )
+	{
+		static const char digits[] = "0123456789abcdef";
+		std::string ret;
+		for ( char c: s )
+		{
+			ret.push_back( digits[uint8_t( c ) >> 4] );
+			ret.push_back( digits[uint8_t( c ) & 0xF] );
+		}
+		return ret;
+	}
+
+	std::string unhex( const std::string &s )
+	{
+		std::string ret;
+		for ( size_t i = 0; i + 1 < s.size(); i += 2 )
+			ret.push_back( char( std::stoul( s.substr( i, 2 ), NULL, 16 ) ) );
+		return ret;
+	}
+
+	bool byAddress( const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b )
+	{
+		return std::make_pair( ntohl( a.first ), ntohl( a.second ) ) < std::make_pair( ntohl( b.first ), ntohl( b.second ) );
+	}
+}
+
+////////////////////////////////////////
+
+memory_backend::memory_backend( void )
+	: _file( configuration["memory_file"] )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	if ( !_file.empty() )
+	{
+		fileChanged();
+		load();
+	}
+	publish();
+}
+
+////////////////////////////////////////
+
+void memory_backend::startLeaseSweeper( void )
+{
+	std::thread( &memory_backend::sweeper, this ).detach();
+}
+
+////////////////////////////////////////
+
+int memory_backend::schemaVersion( void )
+{
+	return schema_version;
+}
+
+////////////////////////////////////////
+
+void memory_backend::migrateSchema( void )
+{
+}
+
+////////////////////////////////////////
+
+void memory_backend::getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases )
+{
+	std::vector< std::tuple<uint32_t, std::string, time_t> > all;
+	for ( stripe &s: _stripes )
+	{
+		std::unique_lock<std::mutex> lock( s.mutex );
+		s.leases.for_each( [&]( uint32_t ip, const lease &l )
+		{
+			all.emplace_back( ntohl( ip ), std::string( reinterpret_cast<const char *>( l.mac ), 6 ), l.expires );
+		} );
+	}
+	std::sort( all.begin(), all.end() );
+
+	for ( auto &l: all )
+	{
+		time_t t = std::get<2>( l );
+		struct tm tm;
+		char expire[32];
+		strftime( expire, sizeof( expire ), "%Y-%m-%dT%T", localtime_r( &t, &tm ) );
+		leases.emplace_back( htonl( std::get<0>( l ) ), std::get<1>( l ), expire );
+	}
+}
+
+////////////////////////////////////////
+
+void memory_backend::getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	for ( auto &h: _hosts )
+		hosts.emplace_back( htonl( h.first ), h.second );
+}
+
+////////////////////////////////////////
+
+void memory_backend::getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	size_t first = options.size();
+	options.insert( options.end(), _options.begin(), _options.end() );
+	std::sort( options.begin() + first, options.end(), []( const std::tuple<uint32_t, uint32_t, std::string> &a, const std::tuple<uint32_t, uint32_t, std::string> &b )
+	{
+		return std::make_tuple( ntohl( std::get<0>( a ) ), ntohl( std::get<1>( a ) ), std::get<2>( a ) ) <
+			std::make_tuple( ntohl( std::get<0>( b ) ), ntohl( std::get<1>( b ) ), std::get<2>( b ) );
+	} );
+}
+
+////////////////////////////////////////
+
+std::vector<uint32_t> memory_backend::getIPAddresses( const uint8_t *mac, bool avail )
+{
+	std::shared_ptr<const host_snapshot> snap = current();
+	if ( !avail )
+		return snap->getIPAddresses( mac );
+
+	// The client's own addresses, then a few free dynamic ones
+	std::vector<uint32_t> ret = snap->getStaticAddresses( mac );
+	ret.erase( std::remove_if( ret.begin(), ret.end(), [=]( uint32_t ip ) { return leaseHeld( ip, mac ); } ), ret.end() );
+	freeAddresses( ret, free_candidates, mac );
+	return ret;
+}
+
+////////////////////////////////////////
+
+std::vector<std::string> memory_backend::getMACAddresses( uint32_t ip )
+{
+	return current()->getMACAddresses( ip );
+}
+
+////////////////////////////////////////
+
+bool memory_backend::addressAvailable( uint32_t ip, const uint8_t *mac )
+{
+	std::vector<uint32_t> own = current()->getStaticAddresses( mac );
+	if ( std::find( own.begin(), own.end(), ip ) != own.end() )
+		return !leaseHeld( ip, mac );
+	return poolAvailable( ip, mac );
+}
+
+////////////////////////////////////////
+
+void memory_backend::getOptions( uint32_t ip, std::vector<std::string> &options )
+{
+	current()->getOptions( ip, options );
+}
+
+////////////////////////////////////////
+
+void memory_backend::addHost( uint32_t ip, const uint8_t *mac )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	if ( _hosts.count( ntohl( ip ) ) > 0 )
+		error( "Duplicate host " + ip_string( ip ) );
+	_hosts[ntohl( ip )] = std::string( reinterpret_cast<const char *>( mac ), 6 );
+	changed();
+}
+
+////////////////////////////////////////
+
+void memory_backend::removeHost( uint32_t ip )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	_hosts.erase( ntohl( ip ) );
+	changed();
+}
+
+////////////////////////////////////////
+
+void memory_backend::addOption( uint32_t ip1, uint32_t ip2, const std::string &opt, bool replace )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	if ( replace )
+	{
+		// Replace the option with the same code
+		for ( auto &o: _options )
+		{
+			if ( std::get<0>( o ) == ip1 && std::get<1>( o ) == ip2 && !std::get<2>( o ).empty() && std::get<2>( o )[0] == opt[0] )
+				std::get<2>( o ) = opt;
+		}
+	}
+	else
+		_options.emplace_back( ip1, ip2, opt );
+	changed();
+
+	invalidateOptionCache();
+}
+
+////////////////////////////////////////
+
+void memory_backend::removeOption( uint32_t ip1, uint32_t ip2, const std::string &opt )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	_options.erase( std::remove( _options.begin(), _options.end(), std::make_tuple( ip1, ip2, opt ) ), _options.end() );
+	changed();
+
+	invalidateOptionCache();
+}
+
+////////////////////////////////////////
+
+void memory_backend::getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	pools = _pools;
+	exclusions = _exclusions;
+	std::sort( pools.begin(), pools.end(), &byAddress );
+	std::sort( exclusions.begin(), exclusions.end(), &byAddress );
+}
+
+////////////////////////////////////////
+
+void memory_backend::addPool( uint32_t ip1, uint32_t ip2, bool exclusion )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	( exclusion ? _exclusions : _pools ).emplace_back( ip1, ip2 );
+	changed();
+}
+
+////////////////////////////////////////
+
+void memory_backend::removePool( uint32_t ip1, uint32_t ip2, bool exclusion )
+{
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	auto &ranges = exclusion ? _exclusions : _pools;
+	ranges.erase( std::remove( ranges.begin(), ranges.end(), std::make_pair( ip1, ip2 ) ), ranges.end() );
+	changed();
+}
+
+////////////////////////////////////////
+
+bool memory_backend::acquireLease( uint32_t ip, const uint8_t *mac, uint32_t time )
+{
+	time_t now = ::time( NULL );
+
+	stripe &s = stripeFor( ip );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	lease *l = s.leases.find( ip );
+	if ( l != NULL && l->expires > now && memcmp( l->mac, mac, 6 ) != 0 )
+		return false;
+
+	if ( l == NULL )
+		l = &s.leases[ip];
+	memcpy( l->mac, mac, 6 );
+	l->expires = now + time;
+	rememberLease( ip, mac, l->expires );
+	return true;
+}
+
+////////////////////////////////////////
+
+bool memory_backend::releaseLease( uint32_t ip, const uint8_t *mac )
+{
+	stripe &s = stripeFor( ip );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	lease *l = s.leases.find( ip );
+	if ( l == NULL || ( mac && memcmp( l->mac, mac, 6 ) != 0 ) )
+		return false;
+
+	s.leases.erase( ip );
+	forgetLease( ip );
+	return true;
+}
+
+////////////////////////////////////////
+
+bool memory_backend::leaseHeld( uint32_t ip, const uint8_t *mac )
+{
+	stripe &s = stripeFor( ip );
+	std::unique_lock<std::mutex> lock( s.mutex );
+	const lease *l = s.leases.find( ip );
+	return l != NULL && l->expires > ::time( NULL ) && memcmp( l->mac, mac, 6 ) != 0;
+}
+
+////////////////////////////////////////
+
+void memory_backend::sweeper( void )
+{
+	while ( 1 )
+	{
+		std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+
+		expireOffers();
+		reload();
+
+		time_t now = ::time( NULL );
+		std::vector<uint32_t> expired;
+		expireLeases( now, expired );
+
+		for ( uint32_t ip: expired )
+		{
+			stripe &s = stripeFor( ip );
+			std::unique_lock<std::mutex> lock( s.mutex );
+			const lease *l = s.leases.find( ip );
+			if ( l != NULL && l->expires <= now )
+			{
+				s.leases.erase( ip );
+				memory_expired.add();
+			}
+		}
+
+		size_t count = 0;
+		for ( stripe &s: _stripes )
+		{
+			std::unique_lock<std::mutex> lock( s.mutex );
+			count += s.leases.size();
+		}
+		memory_leases.set( count );
+	}
+}
+
+////////////////////////////////////////
+
+void memory_backend::changed( void )
+{
+	publish();
+	if ( !_file.empty() )
+		save();
+}
+
+////////////////////////////////////////
+
+void memory_backend::publish( void )
+{
+	std::shared_ptr<host_snapshot> snap = std::make_shared<host_snapshot>();
+	for ( auto &h: _hosts )
+		snap->addHost( htonl( h.first ), h.second );
+	snap->setOptions( _options );
+	snap->setPools( _pools, _exclusions );
+
+	std::atomic_store( &_snapshot, std::shared_ptr<const host_snapshot>( snap ) );
+
+	std::vector<address_range> dynamic = snap->dynamicRanges();
+	buildPools( dynamic );
+	loadClientFilter( snap->boundMACs(), !dynamic.empty() );
+}
+
+////////////////////////////////////////
+
+// The file has a line for each host, option, pool and exclusion:
+//   host <ip> <mac>
+//   option <ip> <ip> <option>
+//   pool <ip> <ip>
+//   exclusion <ip> <ip>
+// with the addresses as numbers (host order), and the MAC and option in hex.
+void memory_backend::load( void )
+{
+	std::ifstream in( _file );
+	if ( !in )
+		return;
+
+	std::string line;
+	while ( std::getline( in, line ) )
+	{
+		std::istringstream str( line );
+		std::string type, data;
+		uint32_t ip1 = 0, ip2 = 0;
+		str >> type >> ip1;
+		if ( type == "host" )
+		{
+			str >> data;
+			_hosts[ip1] = unhex( data );
+		}
+		else if ( type == "option" )
+		{
+			str >> ip2 >> data;
+			_options.emplace_back( htonl( ip1 ), htonl( ip2 ), unhex( data ) );
+		}
+		else if ( type == "pool" || type == "exclusion" )
+		{
+			str >> ip2;
+			( type == "pool" ? _pools : _exclusions ).emplace_back( htonl( ip1 ), htonl( ip2 ) );
+		}
+	}
+}
+
+////////////////////////////////////////
+
+void memory_backend::save( void )
+{
+	std::string tmp = _file + ".tmp";
+	{
+		std::ofstream out( tmp );
+		for ( auto &h: _hosts )
+			out << "host " << h.first << ' ' << hex( h.second ) << '\n';
+		for ( auto &o: _options )
+			out << "option " << ntohl( std::get<0>( o ) ) << ' ' << ntohl( std::get<1>( o ) ) << ' ' << hex( std::get<2>( o ) ) << '\n';
+		for ( auto &p: _pools )
+			out << "pool " << ntohl( p.first ) << ' ' << ntohl( p.second ) << '\n';
+		for ( auto &e: _exclusions )
+			out << "exclusion " << ntohl( e.first ) << ' ' << ntohl( e.second ) << '\n';
+		if ( !out.flush() )
+			error( "Error writing " + tmp );
+	}
+
+	if ( rename( tmp.c_str(), _file.c_str() ) != 0 )
+		error( "Error renaming " + tmp );
+
+	fileChanged();
+}
+
+////////////////////////////////////////
+
+void memory_backend::reload( void )
+{
+	if ( _file.empty() )
+		return;
+
+	std::unique_lock<std::mutex> lock( _table_mutex );
+	if ( !fileChanged() )
+		return;
+
+	_hosts.clear();
+	_options.clear();
+	_pools.clear();
+	_exclusions.clear();
+	load();
+	publish();
+}
+
+////////////////////////////////////////
+
+// Remember the inode and time of the file, and tell if they changed.  The
+// file is always replaced by a rename, so a new inode means a new file.
+bool memory_backend::fileChanged( void )
+{
+	struct stat st;
+	if ( stat( _file.c_str(), &st ) != 0 )
+		return false;
+
+	bool changed = st.st_ino != _file_inode || st.st_mtim.tv_sec != _file_time.tv_sec || st.st_mtim.tv_nsec != _file_time.tv_nsec;
+	_file_inode = st.st_ino;
+	_file_time = st.st_mtim;
+	return changed;
+}
+
+////////////////////////////////////////
+
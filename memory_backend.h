@@ -0,0 +1,137 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include <sys/stat.h>
+
+#include "backend.h"
+#include "flat_map.h"
+#include "host_snapshot.h"
+
+////////////////////////////////////////
+
+// The backend keeping everything in memory, for a server that stands
+// alone, or to measure the server without a database.  The leases are
+// split over stripes, each with its own lock.  The hosts, options and
+// pools are saved to memory_file (if set) whenever they change, and
+// loaded again when another process (such as the command line) changes
+// the file; the leases are not saved.
+class memory_backend : public backend
+{
+public:
+	memory_backend( void );
+
+	void startLeaseSweeper( void ) override;
+
+	int schemaVersion( void ) override;
+	void migrateSchema( void ) override;
+
+	void getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases ) override;
+	void getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts ) override;
+	void getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options ) override;
+
+	std::vector<uint32_t> getIPAddresses( const uint8_t *mac, bool avail ) override;
+	std::vector<std::string> getMACAddresses( uint32_t ip ) override;
+	bool addressAvailable( uint32_t ip, const uint8_t *mac ) override;
+	void getOptions( uint32_t ip, std::vector<std::string> &options ) override;
+
+	void addHost( uint32_t ip, const uint8_t *mac ) override;
+	void removeHost( uint32_t ip ) override;
+
+	void addOption( uint32_t ip1, uint32_t ip2, const std::string &option, bool replace ) override;
+	void removeOption( uint32_t ip1, uint32_t ip2, const std::string &option ) override;
+
+	void getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions ) override;
+	void addPool( uint32_t ip1, uint32_t ip2, bool exclusion ) override;
+	void removePool( uint32_t ip1, uint32_t ip2, bool exclusion ) override;
+
+	bool acquireLease( uint32_t ip, const uint8_t *mac, uint32_t time ) override;
+	bool releaseLease( uint32_t ip, const uint8_t *mac ) override;
+
+protected:
+	// Check if the IP has an unexpired lease to another MAC.
+	virtual bool leaseHeld( uint32_t ip, const uint8_t *mac );
+
+	// Load memory_file again if it was replaced since it was last read
+	// or written.  Called by the sweeper.
+	void reload( void );
+
+	std::shared_ptr<const host_snapshot> current( void ) const
+	{
+		return std::atomic_load( &_snapshot );
+	}
+
+private:
+	struct lease
+	{
+		uint8_t mac[6];
+		time_t expires;
+	};
+
+	struct stripe
+	{
+		std::mutex mutex;
+		flat_map<uint32_t, lease> leases;
+	};
+
+	static const size_t stripes = 64;
+
+	stripe &stripeFor( uint32_t ip )
+	{
+		return _stripes[( ip * 0x9E3779B1u ) >> 26];
+	}
+
+	// Expire the leases and offers every second.
+	void sweeper( void );
+
+	// With the table lock held: publish the changed tables, and save them.
+	void changed( void );
+	void publish( void );
+	void load( void );
+	void save( void );
+
+	bool fileChanged( void );
+
+	stripe _stripes[stripes];
+
+	// The hosts, options and pools (network order), changed under the
+	// table lock, and published as a snapshot for the lookups.
+	std::mutex _table_mutex;
+	std::map<uint32_t, std::string> _hosts; // by IP in host order
+	std::vector< std::tuple<uint32_t, uint32_t, std::string> > _options;
+	std::vector< std::pair<uint32_t, uint32_t> > _pools;
+	std::vector< std::pair<uint32_t, uint32_t> > _exclusions;
+	std::shared_ptr<const host_snapshot> _snapshot;
+
+	std::string _file;
+	struct timespec _file_time = timespec();
+	ino_t _file_inode = 0;
+};
+
+////////////////////////////////////////
+
@@ -0,0 +1,1725 @@
+//
+// Copyright (c) 2012 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <mysql/mysql.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+#include "address_pool.h"
+#include "mysql_backend.h"
+#include "client_filter.h"
+#include "config.h"
+#include "error.h"
+#include "format.h"
+#include "host_snapshot.h"
+#include "guard.h"
+#include "lease_cache.h"
+#include "lease_journal.h"
+#include "log.h"
+#include "lookup.h"
+#include "offer_table.h"
+#include "option_cache.h"
+#include "option_table.h"
+#include "statement.h"
+#include "stats.h"
+
+namespace
+{
+	// A database connection with its statements, opened when first needed.
+	struct connection
+	{
+		MYSQL *db;
+		std::unique_ptr<statement_cache> statements;
+		std::chrono::steady_clock::time_point used;
+	};
+
+	std::mutex pool_mutex;
+	std::condition_variable pool_condition;
+	std::vector<connection*> pool_idle;
+	size_t pool_created = 0;
+	size_t pool_limit = 0;
+	std::chrono::seconds pool_check( 30 );
+
+	thread_local bool thread_started = false;
+
+	// The connection of a thread started with threadStart (a handler or a
+	// command), used without any lock.  The pool is for the background
+	// workers, and for a second connection while the thread's own is in use.
+	thread_local connection *thread_conn = NULL;
+	thread_local bool thread_conn_busy = false;
+
+	stat_counter db_connects( "db_connects" );
+	stat_counter db_pool_waits( "db_pool_waits" );
+
+	MYSQL *openConnection( void )
+	{
+		std::string dbhost = configuration["dbhost"];
+		std::string database = configuration["database"];
+		std::string dbuser = configuration["dbuser"];
+		std::string dbpassword = configuration["dbpassword"];
+
+		MYSQL *db = mysql_init( NULL );
+		if ( db == NULL )
+			error( "Unable to init library" );
+
+		my_bool reconnect = 1;
+		unsigned int protocol = MYSQL_PROTOCOL_TCP;
+		mysql_options( db, MYSQL_OPT_RECONNECT, &reconnect );
+		mysql_options( db, MYSQL_OPT_PROTOCOL, (const char *)&protocol );
+
+		if ( mysql_real_connect( db, dbhost.c_str(), dbuser.c_str(), dbpassword.c_str(), database.c_str(), 0, NULL, CLIENT_MULTI_STATEMENTS ) == NULL )
+		{
+			std::string msg = mysql_error( db );
+			mysql_close( db );
+			error( "Unable to open mysql: " + msg );
+		}
+
+		db_connects.add();
+		return db;
+	}
+
+	void closeConnection( connection *c )
+	{
+		if ( c->db )
+		{
+			c->statements.reset();
+			mysql_close( c->db );
+			c->db = NULL;
+		}
+	}
+
+	void configure( void )
+	{
+		static std::once_flag configured;
+		std::call_once( configured, []()
+		{
+			std::string dbhost = configuration["dbhost"];
+			std::string database = configuration["database"];
+			std::string dbuser = configuration["dbuser"];
+			std::string dbpassword = configuration["dbpassword"];
+
+			if ( dbhost.empty() || database.empty() || dbuser.empty() || dbpassword.empty() )
+				error( "Invalid configuration of database" );
+
+			pool_limit = std::max( 1, config_int( "db_connections", 8 ) );
+			pool_check = std::chrono::seconds( config_int( "db_check_interval", 30 ) );
+		} );
+	}
+
+	// Start a background worker thread (using the pool).
+	void workerStart( void )
+	{
+		configure();
+		if ( !thread_started )
+		{
+			mysql_thread_init();
+			thread_started = true;
+		}
+	}
+
+	// The thread's own connection, or one checked out of the pool, for the
+	// length of a backend call.
+	class pooled
+	{
+	public:
+		pooled( void )
+			: _conn( NULL )
+		{
+			if ( !thread_started )
+				workerStart();
+
+			if ( thread_conn && !thread_conn_busy )
+			{
+				_conn = thread_conn;
+				thread_conn_busy = true;
+			}
+			else
+				checkout();
+
+			// Connect (or check the connection) outside of the lock
+			try
+			{
+				if ( _conn->db && std::chrono::steady_clock::now() - _conn->used > pool_check && mysql_ping( _conn->db ) != 0 )
+					closeConnection( _conn );
+				if ( _conn->db == NULL )
+				{
+					_conn->db = openConnection();
+					_conn->statements.reset( new statement_cache( _conn->db ) );
+				}
+			}
+			catch ( ... )
+			{
+				release();
+				throw;
+			}
+		}
+
+		~pooled( void )
+		{
+			release();
+		}
+
+		operator MYSQL *( void ) const
+		{
+			return _conn->db;
+		}
+
+		operator statement_cache &( void ) const
+		{
+			return *_conn->statements;
+		}
+
+	private:
+		pooled( const pooled & ) = delete;
+		pooled &operator=( const pooled & ) = delete;
+
+		void checkout( void )
+		{
+			std::unique_lock<std::mutex> lock( pool_mutex );
+			if ( pool_idle.empty() && pool_created >= pool_limit )
+			{
+				db_pool_waits.add();
+				while ( pool_idle.empty() )
+					pool_condition.wait( lock );
+			}
+
+			if ( !pool_idle.empty() )
+			{
+				_conn = pool_idle.back();
+				pool_idle.pop_back();
+			}
+			else
+			{
+				_conn = new connection;
+				_conn->db = NULL;
+				++pool_created;
+			}
+		}
+
+		void release( void )
+		{
+			_conn->used = std::chrono::steady_clock::now();
+			if ( _conn == thread_conn )
+			{
+				thread_conn_busy = false;
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock( pool_mutex );
+			pool_idle.push_back( _conn );
+			pool_condition.notify_one();
+		}
+
+		connection *_conn;
+	};
+}
+
+////////////////////////////////////////
+
+namespace
+{
+	// Free dynamic addresses returned for a client to choose from
+	const size_t free_candidates = 8;
+
+	// The published snapshot of hosts and options (NULL when not loaded).
+	std::shared_ptr<const host_snapshot> snapshot;
+
+	std::shared_ptr<const host_snapshot> currentSnapshot( void )
+	{
+		return std::atomic_load( &snapshot );
+	}
+}
+////////////////////////////////////////
+
+void mysql_backend::threadStart( void )
+{
+	workerStart();
+	if ( thread_conn == NULL )
+	{
+		thread_conn = new connection;
+		thread_conn->db = NULL;
+	}
+}
+
+////////////////////////////////////////
+
+void mysql_backend::threadStop( void )
+{
+	if ( thread_conn )
+	{
+		closeConnection( thread_conn );
+		delete thread_conn;
+		thread_conn = NULL;
+	}
+
+	if ( thread_started )
+	{
+		mysql_thread_end();
+		thread_started = false;
+	}
+}
+
+////////////////////////////////////////
+
+void mysql_backend::getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &hosts )
+{
+	pooled db;
+
+	statement &s = prepared( db, "SELECT ip_addr, mac_addr, DATE_FORMAT( FROM_UNIXTIME( expiration ), '%Y-%m-%dT%T') as expire FROM dhcp_lease ORDER BY ip_addr", "uss" );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+
+	while ( s.fetch() )
+		hosts.emplace_back( htonl( s.number( 0 ) ), s.text( 1 ), s.text( 2 ) );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts )
+{
+	pooled db;
+
+	statement &s = prepared( db, "SELECT ip_addr, mac_addr FROM dhcp_host ORDER BY ip_addr", "us" );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+
+	while ( s.fetch() )
+		hosts.emplace_back( htonl( s.number( 0 ) ), s.text( 1 ) );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options )
+{
+	pooled db;
+
+	statement &s = prepared( db, "SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options ORDER BY ip_addr_from, ip_addr_to, options", "uus" );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+
+	while ( s.fetch() )
+		options.emplace_back( htonl( s.number( 0 ) ), htonl( s.number( 1 ) ), s.text( 2 ) );
+}
+
+////////////////////////////////////////
+
+namespace
+{
+
+// Read the pools and exclusions (network order).
+void readPools( pooled &db, std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions )
+{
+	statement &p = prepared( db, "SELECT ip_addr_from, ip_addr_to FROM dhcp_pool ORDER BY ip_addr_from", "uu" );
+	if ( !p.execute() )
+		error( std::string( "Error querying mysql: " ) + p.error() );
+	while ( p.fetch() )
+		pools.emplace_back( htonl( p.number( 0 ) ), htonl( p.number( 1 ) ) );
+
+	statement &e = prepared( db, "SELECT ip_addr_from, ip_addr_to FROM dhcp_exclusion ORDER BY ip_addr_from", "uu" );
+	if ( !e.execute() )
+		error( std::string( "Error querying mysql: " ) + e.error() );
+	while ( e.fetch() )
+		exclusions.emplace_back( htonl( e.number( 0 ) ), htonl( e.number( 1 ) ) );
+}
+
+////////////////////////////////////////
+
+// Append up to max free addresses from the pools, skipping exclusions,
+// other clients' hosts and live leases.  Only the rows in use are read.
+void poolCandidates( pooled &db, const uint8_t *hwaddr, std::vector<uint32_t> &ips, size_t max )
+{
+	std::vector<address_range> pools, holes;
+
+	statement &p = prepared( db, "SELECT ip_addr_from, ip_addr_to FROM dhcp_pool", "uu" );
+	if ( !p.execute() )
+		error( std::string( "Error querying mysql: " ) + p.error() );
+	while ( p.fetch() )
+		pools.push_back( { p.number( 0 ), p.number( 1 ) } );
+
+	if ( pools.empty() )
+		return;
+
+	// Only hosts and leases inside a pool matter, the rest of the static
+	// hosts needn't be read
+	statement &e = prepared( db,
+		"SELECT ip_addr_from, ip_addr_to FROM dhcp_exclusion "
+		"UNION ALL SELECT h.ip_addr, h.ip_addr FROM dhcp_host h "
+			"JOIN dhcp_pool p ON h.ip_addr BETWEEN p.ip_addr_from AND p.ip_addr_to "
+			"WHERE h.mac_addr <> ? AND h.mac_addr <> x'000000000000' "
+		"UNION ALL SELECT l.ip_addr, l.ip_addr FROM dhcp_lease l "
+			"JOIN dhcp_pool p ON l.ip_addr BETWEEN p.ip_addr_from AND p.ip_addr_to "
+			"WHERE l.mac_addr <> ? AND l.expiration > UNIX_TIMESTAMP()", "uu" );
+	e.bind( 0, hwaddr, 6 );
+	e.bind( 1, hwaddr, 6 );
+	if ( !e.execute() )
+		error( std::string( "Error querying mysql: " ) + e.error() );
+	while ( e.fetch() )
+		holes.push_back( { e.number( 0 ), e.number( 1 ) } );
+
+	// Start at a point given by the client's MAC, so clients asking at
+	// the same time don't all race for the lowest address
+	std::vector<address_range> free = subtractRanges( mergeRanges( pools ), mergeRanges( holes ) );
+	uint64_t total = 0;
+	for ( const address_range &r: free )
+		total += uint64_t( r.last ) - r.first + 1;
+	if ( total == 0 )
+		return;
+
+	// Find the range and address to start from, then walk the free
+	// ranges in order, wrapping around to the first
+	uint64_t skip = macHash( hwaddr ) % total;
+	size_t k = 0;
+	while ( skip > uint64_t( free[k].last ) - free[k].first )
+	{
+		skip -= uint64_t( free[k].last ) - free[k].first + 1;
+		++k;
+	}
+
+	uint64_t ip = free[k].first + skip;
+	for ( uint64_t n = 0; n < max && n < total; ++n )
+	{
+		ips.push_back( htonl( uint32_t( ip ) ) );
+		if ( ip++ == free[k].last )
+		{
+			k = ( k + 1 ) % free.size();
+			ip = free[k].first;
+		}
+	}
+}
+
+}
+
+////////////////////////////////////////
+
+std::vector<uint32_t> mysql_backend::getIPAddresses( const uint8_t *hwaddr, bool avail )
+{
+	if ( auto snap = currentSnapshot() )
+	{
+		if ( !avail )
+			return snap->getIPAddresses( hwaddr );
+
+		// The client's own addresses, then a few free dynamic ones
+		std::vector<uint32_t> ret = snap->getStaticAddresses( hwaddr );
+		ret.erase( std::remove_if( ret.begin(), ret.end(), [=]( uint32_t ip ) { return leaseHeld( ip, hwaddr ); } ), ret.end() );
+		freeAddresses( ret, free_candidates, hwaddr );
+		return ret;
+	}
+
+	pooled db;
+
+	statement *s;
+	if ( avail )
+	{
+		s = &prepared( db,
+			"SELECT ip_addr, mac_addr = x'000000000000' FROM dhcp_host "
+				"WHERE ( mac_addr = ? OR mac_addr = x'000000000000' ) "
+				"AND ip_addr NOT IN ( SELECT ip_addr FROM dhcp_lease WHERE mac_addr <> ? AND expiration > UNIX_TIMESTAMP() ) "
+				"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC", "uu" );
+		s->bind( 0, hwaddr, 6 );
+		s->bind( 1, hwaddr, 6 );
+	}
+	else
+	{
+		s = &prepared( db,
+			"SELECT ip_addr FROM dhcp_host "
+				"WHERE mac_addr = ? OR mac_addr = x'000000000000' "
+				"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC", "u" );
+		s->bind( 0, hwaddr, 6 );
+	}
+
+	if ( !s->execute() )
+		error( format( "Error querying mysql: {0}", s->error() ) );
+
+	std::vector<uint32_t> ret;
+	size_t own = 0;
+	while ( s->fetch() )
+	{
+		ret.push_back( htonl( s->number( 0 ) ) );
+		if ( !avail || s->number( 1 ) == 0 )
+			++own;
+	}
+
+	if ( avail )
+	{
+		// Start the dynamic hosts (after the client's own) at a point given
+		// by the client's MAC, as with the pools
+		if ( ret.size() > own )
+			std::rotate( ret.begin() + own, ret.begin() + own + macHash( hwaddr ) % ( ret.size() - own ), ret.end() );
+		poolCandidates( db, hwaddr, ret, free_candidates );
+	}
+
+	return ret;
+}
+
+////////////////////////////////////////
+
+bool mysql_backend::addressAvailable( uint32_t ip, const uint8_t *hwaddr )
+{
+	if ( auto snap = currentSnapshot() )
+	{
+		std::vector<uint32_t> own = snap->getStaticAddresses( hwaddr );
+		if ( std::find( own.begin(), own.end(), ip ) != own.end() )
+			return !leaseHeld( ip, hwaddr );
+		return poolAvailable( ip, hwaddr );
+	}
+
+	{
+		pooled db;
+		statement &s = prepared( db,
+			"SELECT 1 FROM dhcp_pool WHERE ? BETWEEN ip_addr_from AND ip_addr_to "
+				"AND NOT EXISTS ( SELECT 1 FROM dhcp_exclusion WHERE ? BETWEEN ip_addr_from AND ip_addr_to ) "
+				"AND NOT EXISTS ( SELECT 1 FROM dhcp_host WHERE ip_addr = ? AND mac_addr <> ? AND mac_addr <> x'000000000000' ) "
+				"AND NOT EXISTS ( SELECT 1 FROM dhcp_lease WHERE ip_addr = ? AND mac_addr <> ? AND expiration > UNIX_TIMESTAMP() ) "
+			"LIMIT 1", "u" );
+		s.bind( 0, ntohl( ip ) );
+		s.bind( 1, ntohl( ip ) );
+		s.bind( 2, ntohl( ip ) );
+		s.bind( 3, hwaddr, 6 );
+		s.bind( 4, ntohl( ip ) );
+		s.bind( 5, hwaddr, 6 );
+		if ( !s.execute() )
+			error( std::string( "Error querying mysql: " ) + s.error() );
+		if ( s.fetch() )
+			return true;
+	}
+
+	std::vector<uint32_t> ips = getIPAddresses( hwaddr, true );
+	return std::find( ips.begin(), ips.end(), ip ) != ips.end();
+}
+
+////////////////////////////////////////
+
+std::vector<std::string> mysql_backend::getMACAddresses( uint32_t ip )
+{
+	if ( auto snap = currentSnapshot() )
+		return snap->getMACAddresses( ip );
+
+	pooled db;
+
+	statement &s = prepared( db,
+		"SELECT mac_addr FROM dhcp_host "
+			"WHERE ip_addr = ? "
+			"ORDER BY mac_addr DESC, dhcp_host.ip_addr ASC", "s" );
+	s.bind( 0, ntohl( ip ) );
+
+	if ( !s.execute() )
+		error( format( "Error querying mysql: {0}", s.error() ) );
+
+	std::vector<std::string> ret;
+	while ( s.fetch() )
+		ret.push_back( s.text( 0 ) );
+
+	return ret;
+}
+
+////////////////////////////////////////
+
+void mysql_backend::getOptions( uint32_t ip, std::vector<std::string> &options )
+{
+	if ( auto snap = currentSnapshot() )
+	{
+		snap->getOptions( ip, options );
+		return;
+	}
+
+	pooled db;
+
+	statement &s = prepared( db, "SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options WHERE ( ? >= ip_addr_from AND ? <= ip_addr_to )", "uus" );
+	s.bind( 0, ntohl( ip ) );
+	s.bind( 1, ntohl( ip ) );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+
+	// The same precedence as the snapshot: the smallest range wins
+	std::vector<option_range> rows;
+	while ( s.fetch() )
+		rows.push_back( { s.number( 0 ), s.number( 1 ), s.text( 2 ) } );
+
+	std::vector<const option_range *> covering;
+	for ( const option_range &r: rows )
+		covering.push_back( &r );
+	mergeOptions( covering, options );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::addHost( uint32_t ip, const uint8_t *mac )
+{
+	pooled db;
+
+	statement &s = prepared( db, "INSERT INTO dhcp_host ( ip_addr, mac_addr ) VALUES( ?, ? )" );
+	s.bind( 0, ntohl( ip ) );
+	s.bind( 1, mac, 6 );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::removeHost( uint32_t ip )
+{
+	pooled db;
+
+	statement &s = prepared( db, "DELETE FROM dhcp_host WHERE ip_addr = ?" );
+	s.bind( 0, ntohl( ip ) );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::addOption( uint32_t ip1, uint32_t ip2, const std::string &opt, bool replace )
+{
+	pooled db;
+
+	statement *s;
+	if ( replace )
+	{
+		// Replace the option with the same code
+		s = &prepared( db, "UPDATE dhcp_options "
+			"SET options = ? WHERE ( ip_addr_from = ? AND ip_addr_to = ? AND code = ? )" );
+		s->bind( 0, opt );
+		s->bind( 1, ntohl( ip1 ) );
+		s->bind( 2, ntohl( ip2 ) );
+		s->bind( 3, uint32_t( uint8_t( opt[0] ) ) );
+	}
+	else
+	{
+		s = &prepared( db, "INSERT INTO dhcp_options ( ip_addr_from, ip_addr_to, code, options ) VALUES( ?, ?, ?, ? )" );
+		s->bind( 0, ntohl( ip1 ) );
+		s->bind( 1, ntohl( ip2 ) );
+		s->bind( 2, uint32_t( uint8_t( opt[0] ) ) );
+		s->bind( 3, opt );
+	}
+
+	if ( !s->execute() )
+		error( std::string( "Error querying mysql: " ) + s->error() );
+
+	invalidateOptionCache();
+}
+
+////////////////////////////////////////
+
+void mysql_backend::removeOption( uint32_t ip1, uint32_t ip2, const std::string &opt )
+{
+	pooled db;
+
+	statement &s = prepared( db, "DELETE FROM dhcp_options WHERE ip_addr_from = ? AND ip_addr_to = ? AND options = ?" );
+	s.bind( 0, ntohl( ip1 ) );
+	s.bind( 1, ntohl( ip2 ) );
+	s.bind( 2, opt );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+
+	invalidateOptionCache();
+}
+
+////////////////////////////////////////
+
+void mysql_backend::getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions )
+{
+	pooled db;
+	readPools( db, pools, exclusions );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::addPool( uint32_t ip1, uint32_t ip2, bool exclusion )
+{
+	pooled db;
+
+	statement &s = exclusion ?
+		prepared( db, "INSERT INTO dhcp_exclusion ( ip_addr_from, ip_addr_to ) VALUES( ?, ? )" ) :
+		prepared( db, "INSERT INTO dhcp_pool ( ip_addr_from, ip_addr_to ) VALUES( ?, ? )" );
+	s.bind( 0, ntohl( ip1 ) );
+	s.bind( 1, ntohl( ip2 ) );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::removePool( uint32_t ip1, uint32_t ip2, bool exclusion )
+{
+	pooled db;
+
+	statement &s = exclusion ?
+		prepared( db, "DELETE FROM dhcp_exclusion WHERE ip_addr_from = ? AND ip_addr_to = ?" ) :
+		prepared( db, "DELETE FROM dhcp_pool WHERE ip_addr_from = ? AND ip_addr_to = ?" );
+	s.bind( 0, ntohl( ip1 ) );
+	s.bind( 1, ntohl( ip2 ) );
+
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+}
+
+////////////////////////////////////////
+
+namespace
+{
+	// Run a query returning a count.
+	uint64_t queryCount( MYSQL *db, const char *sql )
+	{
+		if ( mysql_query( db, sql ) != 0 )
+			error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+
+		MYSQL_RES *result = mysql_store_result( db );
+		auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
+
+		if ( result == NULL )
+			error( std::string( "Error storing result from mysql: " ) + mysql_error( db ) );
+
+		MYSQL_ROW row = mysql_fetch_row( result );
+		if ( row == NULL || row[0] == NULL )
+			return 0;
+		return strtoull( row[0], NULL, 10 );
+	}
+}
+
+////////////////////////////////////////
+
+int mysql_backend::schemaVersion( void )
+{
+	pooled db;
+
+	if ( mysql_query( db, "SELECT MAX( version ) FROM dhcp_schema" ) != 0 )
+	{
+		// No version table: the original schema
+		if ( mysql_errno( db ) == 1146 )
+			return 1;
+		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+	}
+
+	MYSQL_RES *result = mysql_store_result( db );
+	auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
+
+	if ( result == NULL )
+		error( std::string( "Error storing result from mysql: " ) + mysql_error( db ) );
+
+	MYSQL_ROW row = mysql_fetch_row( result );
+	if ( row == NULL || row[0] == NULL )
+		return 1;
+	return atoi( row[0] );
+}
+
+////////////////////////////////////////
+
+void mysql_backend::migrateSchema( void )
+{
+	// Steps to upgrade from each version to the next.
+	// Duplicate column, index and trigger errors are ignored, and a step
+	// that cannot be repeated only runs while its condition (a count) is
+	// not 0, so a migration that was interrupted can be run again.
+	struct migration
+	{
+		const char *sql;
+		const char *when;
+	};
+
+	// The lease expiration has not been converted to a number yet
+	static const char *datetime_expiration =
+		"SELECT COUNT(*) FROM information_schema.COLUMNS "
+			"WHERE TABLE_SCHEMA = DATABASE() AND TABLE_NAME = 'dhcp_lease' "
+			"AND COLUMN_NAME = 'expiration' AND DATA_TYPE <> 'int'";
+
+	static const std::vector< std::vector<migration> > steps =
+	{
+		// 1 -> 2
+		{
+			{ "CREATE TABLE IF NOT EXISTS dhcp_schema ( version INT UNSIGNED NOT NULL )" },
+			{ "ALTER TABLE dhcp_host ADD INDEX mac_addr ( mac_addr )" },
+			{ "ALTER TABLE dhcp_options MODIFY id BIGINT UNSIGNED NOT NULL AUTO_INCREMENT" },
+			{ "ALTER TABLE dhcp_options ADD COLUMN code TINYINT UNSIGNED NOT NULL DEFAULT 0 AFTER ip_addr_to" },
+			{ "UPDATE dhcp_options SET code = ASCII( options )" },
+			{ "ALTER TABLE dhcp_options ADD INDEX ip_range ( ip_addr_from, ip_addr_to, code )" },
+			{ "ALTER TABLE dhcp_lease ADD COLUMN expires INT UNSIGNED NOT NULL DEFAULT 0", datetime_expiration },
+			{ "UPDATE dhcp_lease SET expires = UNIX_TIMESTAMP( expiration )", datetime_expiration },
+			{ "ALTER TABLE dhcp_lease DROP COLUMN expiration, CHANGE expires expiration INT UNSIGNED NOT NULL, "
+				"ADD INDEX mac_addr ( mac_addr ), ADD INDEX expiration ( expiration )", datetime_expiration },
+		},
+
+		// 2 -> 3
+		{
+			{ "CREATE TABLE IF NOT EXISTS dhcp_change ( "
+				"id BIGINT UNSIGNED NOT NULL AUTO_INCREMENT, "
+				"tbl TINYINT UNSIGNED NOT NULL, "
+				"ip_addr INT UNSIGNED NOT NULL, "
+				"changed TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP, "
+				"PRIMARY KEY(id), INDEX changed(changed) )" },
+			{ "CREATE TRIGGER dhcp_host_insert AFTER INSERT ON dhcp_host FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 1, NEW.ip_addr )" },
+			{ "CREATE TRIGGER dhcp_host_update AFTER UPDATE ON dhcp_host FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 1, OLD.ip_addr ), ( 1, NEW.ip_addr )" },
+			{ "CREATE TRIGGER dhcp_host_delete AFTER DELETE ON dhcp_host FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 1, OLD.ip_addr )" },
+			{ "CREATE TRIGGER dhcp_options_insert AFTER INSERT ON dhcp_options FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 2, NEW.ip_addr_from )" },
+			{ "CREATE TRIGGER dhcp_options_update AFTER UPDATE ON dhcp_options FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 2, OLD.ip_addr_from ), ( 2, NEW.ip_addr_from )" },
+			{ "CREATE TRIGGER dhcp_options_delete AFTER DELETE ON dhcp_options FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 2, OLD.ip_addr_from )" },
+			{ "CREATE TRIGGER dhcp_lease_insert AFTER INSERT ON dhcp_lease FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 3, NEW.ip_addr )" },
+			{ "CREATE TRIGGER dhcp_lease_update AFTER UPDATE ON dhcp_lease FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 3, NEW.ip_addr )" },
+			{ "CREATE TRIGGER dhcp_lease_delete AFTER DELETE ON dhcp_lease FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 3, OLD.ip_addr )" },
+		},
+
+		// 3 -> 4
+		{
+			{ "CREATE TABLE IF NOT EXISTS dhcp_pool ( "
+				"ip_addr_from INT UNSIGNED NOT NULL, "
+				"ip_addr_to INT UNSIGNED NOT NULL, "
+				"PRIMARY KEY(ip_addr_from, ip_addr_to) )" },
+			{ "CREATE TABLE IF NOT EXISTS dhcp_exclusion ( "
+				"ip_addr_from INT UNSIGNED NOT NULL, "
+				"ip_addr_to INT UNSIGNED NOT NULL, "
+				"PRIMARY KEY(ip_addr_from, ip_addr_to) )" },
+			{ "CREATE TRIGGER dhcp_pool_insert AFTER INSERT ON dhcp_pool FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, NEW.ip_addr_from )" },
+			{ "CREATE TRIGGER dhcp_pool_delete AFTER DELETE ON dhcp_pool FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, OLD.ip_addr_from )" },
+			{ "CREATE TRIGGER dhcp_exclusion_insert AFTER INSERT ON dhcp_exclusion FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, NEW.ip_addr_from )" },
+			{ "CREATE TRIGGER dhcp_exclusion_delete AFTER DELETE ON dhcp_exclusion FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, OLD.ip_addr_from )" },
+		},
+
+		// 4 -> 5
+		{
+			// An update moving an option range reloads the old start too
+			{ "DROP TRIGGER IF EXISTS dhcp_options_update" },
+			{ "CREATE TRIGGER dhcp_options_update AFTER UPDATE ON dhcp_options FOR EACH ROW "
+				"INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 2, OLD.ip_addr_from ), ( 2, NEW.ip_addr_from )" },
+		},
+	};
+
+	int version = schemaVersion();
+	pooled db;
+
+	for ( size_t v = version - 1; v < steps.size(); ++v )
+	{
+		for ( const migration &m: steps[v] )
+		{
+			if ( m.when && queryCount( db, m.when ) == 0 )
+				continue;
+
+			if ( mysql_query( db, m.sql ) != 0 )
+			{
+				unsigned int err = mysql_errno( db );
+				if ( err != 1060 && err != 1061 && err != 1359 )
+					error( format( "Error migrating to schema {0}: {1}", v + 2, mysql_error( db ) ) );
+			}
+		}
+
+		std::string query = format( "DELETE FROM dhcp_schema; INSERT INTO dhcp_schema VALUES ( {0} )", v + 2 );
+		if ( mysql_query( db, query.c_str() ) != 0 )
+			error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+		while ( mysql_next_result( db ) == 0 )
+			;
+	}
+}
+
+////////////////////////////////////////
+
+namespace
+{
+
+// The outcome of a lease write: done, refused (the lease is another
+// MAC's, or there was none to drop), or failed (kept for a retry).
+enum lease_write
+{
+	LEASE_DONE,
+	LEASE_REFUSED,
+	LEASE_ERROR
+};
+
+lease_write claimLease( pooled &db, uint32_t ip, const uint8_t *hwaddr, uint32_t time )
+{
+	// Insert the lease, or take over the row if it is ours or has expired.
+	// The MAC is assigned first, so the expiration only changes if the MAC matches.
+	statement &s = prepared( db,
+		"INSERT INTO dhcp_lease ( ip_addr, mac_addr, expiration ) "
+			"VALUES( ?, ?, UNIX_TIMESTAMP() + ? ) "
+		"ON DUPLICATE KEY UPDATE "
+			"mac_addr = IF( mac_addr = VALUES( mac_addr ) OR expiration <= UNIX_TIMESTAMP(), VALUES( mac_addr ), mac_addr ), "
+			"expiration = IF( mac_addr = VALUES( mac_addr ), VALUES( expiration ), expiration )" );
+	s.bind( 0, ntohl( ip ) );
+	s.bind( 1, hwaddr, 6 );
+	s.bind( 2, time );
+
+	if ( !s.execute() )
+	{
+		logMessage( LOG_ERR, LOGT_ERROR, "Acquire lease: %s", s.error() );
+		return LEASE_ERROR;
+	}
+
+	// 1 for a new row, 2 for a changed row, 0 if nothing changed
+	uint64_t affected = s.affected();
+	if ( affected == 1 || affected == 2 )
+		return LEASE_DONE;
+
+	// Nothing changed: either the row is someone else's, or it is ours and
+	// was renewed within the same second.
+	statement &check = prepared( db, "SELECT 1 FROM dhcp_lease WHERE ip_addr = ? AND mac_addr = ?", "u" );
+	check.bind( 0, ntohl( ip ) );
+	check.bind( 1, hwaddr, 6 );
+
+	if ( !check.execute() )
+	{
+		logMessage( LOG_ERR, LOGT_ERROR, "Acquire lease: %s", check.error() );
+		return LEASE_ERROR;
+	}
+
+	if ( check.fetch() )
+		return LEASE_DONE;
+	logMessage( LOG_INFO, LOGT_LEASE, "Lease expiration: ip is already assigned" );
+	return LEASE_REFUSED;
+}
+
+////////////////////////////////////////
+
+lease_write dropLease( pooled &db, uint32_t ip, const uint8_t *hwaddr )
+{
+	statement *s;
+	if ( hwaddr )
+	{
+		s = &prepared( db, "DELETE FROM dhcp_lease WHERE ip_addr = ? AND mac_addr = ?" );
+		s->bind( 0, ntohl( ip ) );
+		s->bind( 1, hwaddr, 6 );
+	}
+	else
+	{
+		s = &prepared( db, "DELETE FROM dhcp_lease WHERE ip_addr = ?" );
+		s->bind( 0, ntohl( ip ) );
+	}
+
+	if ( !s->execute() )
+	{
+		logMessage( LOG_ERR, LOGT_ERROR, "Release lease: %s", s->error() );
+		return LEASE_ERROR;
+	}
+
+	return s->affected() < 1 ? LEASE_REFUSED : LEASE_DONE;
+}
+
+////////////////////////////////////////
+
+// Lease writes from the handlers, waiting to be committed as a group.
+struct lease_intent
+{
+	bool acquire;
+	uint32_t ip;
+	uint8_t mac[6];
+	bool any_mac;
+	uint32_t time;
+	bool result;
+	bool done;
+};
+
+std::mutex intent_mutex;
+std::condition_variable intent_condition;
+std::condition_variable intent_done;
+std::vector<lease_intent*> intents;
+
+stat_counter group_commits( "lease_group_commits" );
+stat_counter group_rows( "lease_group_rows" );
+
+////////////////////////////////////////
+
+// The current state of a leased IP within a group commit.
+struct lease_row
+{
+	std::string mac;
+	bool active;
+	bool changed;
+	uint32_t time;
+};
+
+// Apply the intents in one transaction, setting the result of each.
+void commitIntents( pooled &db, std::vector<lease_intent*> &batch )
+{
+	for ( lease_intent *i: batch )
+		i->result = false;
+
+	std::string ips;
+	for ( lease_intent *i: batch )
+	{
+		if ( !ips.empty() )
+			ips.push_back( ',' );
+		ips += format( "{0}", ntohl( i->ip ) );
+	}
+
+	if ( mysql_query( db, "START TRANSACTION" ) != 0 )
+	{
+		logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", mysql_error( db ) );
+		return;
+	}
+	auto rollback = make_guard( [&]() { mysql_query( db, "ROLLBACK" ); } );
+
+	// Lock the current rows for the IPs
+	std::map<uint32_t,lease_row> rows;
+	{
+		std::string query = format( "SELECT ip_addr, mac_addr, expiration > UNIX_TIMESTAMP() FROM dhcp_lease WHERE ip_addr IN ( {0} ) FOR UPDATE", ips );
+		if ( mysql_query( db, query.c_str() ) != 0 )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", mysql_error( db ) );
+			return;
+		}
+
+		MYSQL_RES *result = mysql_store_result( db );
+		auto freeres = make_guard( [=](){ mysql_free_result( result ); } );
+		if ( result == NULL )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", mysql_error( db ) );
+			return;
+		}
+
+		MYSQL_ROW row;
+		while ( ( row = mysql_fetch_row( result ) ) )
+		{
+			unsigned long *lengths = mysql_fetch_lengths( result );
+			lease_row &r = rows[htonl( std::stoul( std::string( row[0], lengths[0] ) ) )];
+			r.mac = std::string( row[1], lengths[1] );
+			r.active = row[2] && row[2][0] == '1';
+			r.changed = false;
+			r.time = 0;
+		}
+	}
+
+	// Decide each intent in order, against the rows and the earlier intents
+	for ( lease_intent *i: batch )
+	{
+		std::string mac( reinterpret_cast<const char *>( i->mac ), 6 );
+		auto r = rows.find( i->ip );
+		if ( i->acquire )
+		{
+			if ( r != rows.end() && r->second.active && r->second.mac != mac )
+				continue;
+			lease_row &n = rows[i->ip];
+			n.mac = mac;
+			n.active = true;
+			n.changed = true;
+			n.time = i->time;
+			i->result = true;
+		}
+		else if ( r != rows.end() && ( i->any_mac || r->second.mac == mac ) )
+		{
+			rows.erase( r );
+			i->result = true;
+		}
+	}
+
+	// Write the final state of each IP
+	std::string inserts, deletes;
+	for ( lease_intent *i: batch )
+	{
+		auto r = rows.find( i->ip );
+		if ( r == rows.end() )
+		{
+			if ( i->result )
+			{
+				if ( !deletes.empty() )
+					deletes.push_back( ',' );
+				deletes += format( "{0}", ntohl( i->ip ) );
+			}
+		}
+		else if ( r->second.changed )
+		{
+			if ( !inserts.empty() )
+				inserts.push_back( ',' );
+			inserts += format( "( {0}, x'{1,B16,f0,w2}', UNIX_TIMESTAMP() + {2} )",
+				ntohl( i->ip ), as_hex<char>( r->second.mac ), r->second.time );
+			r->second.changed = false;
+		}
+	}
+
+	if ( !inserts.empty() )
+	{
+		std::string query = "INSERT INTO dhcp_lease ( ip_addr, mac_addr, expiration ) VALUES " + inserts +
+			" ON DUPLICATE KEY UPDATE mac_addr = VALUES( mac_addr ), expiration = VALUES( expiration )";
+		if ( mysql_query( db, query.c_str() ) != 0 )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", mysql_error( db ) );
+			for ( lease_intent *i: batch )
+				i->result = false;
+			return;
+		}
+	}
+
+	if ( !deletes.empty() )
+	{
+		std::string query = "DELETE FROM dhcp_lease WHERE ip_addr IN ( " + deletes + " )";
+		if ( mysql_query( db, query.c_str() ) != 0 )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", mysql_error( db ) );
+			for ( lease_intent *i: batch )
+				i->result = false;
+			return;
+		}
+	}
+
+	if ( mysql_query( db, "COMMIT" ) != 0 )
+	{
+		logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", mysql_error( db ) );
+		for ( lease_intent *i: batch )
+			i->result = false;
+		return;
+	}
+	rollback.commit();
+
+	group_commits.add();
+	group_rows.add( batch.size() );
+}
+
+////////////////////////////////////////
+
+void leaseWriter( int delay )
+{
+	workerStart();
+
+	while ( 1 )
+	{
+		std::vector<lease_intent*> batch;
+		{
+			std::unique_lock<std::mutex> lock( intent_mutex );
+			while ( intents.empty() )
+				intent_condition.wait( lock );
+
+			// Give other handlers a moment to add their leases
+			lock.unlock();
+			std::this_thread::sleep_for( std::chrono::milliseconds( delay ) );
+			lock.lock();
+
+			batch.swap( intents );
+		}
+
+		try
+		{
+			pooled db;
+			commitIntents( db, batch );
+		}
+		catch ( std::exception &e )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", e.what() );
+			for ( lease_intent *i: batch )
+				i->result = false;
+		}
+
+		std::unique_lock<std::mutex> lock( intent_mutex );
+		for ( lease_intent *i: batch )
+			i->done = true;
+		intent_done.notify_all();
+	}
+}
+
+////////////////////////////////////////
+
+// Queue the intent for the lease writer and wait for the result.
+// Returns false if group commit is not enabled.
+bool groupCommit( lease_intent &i )
+{
+	static const int delay = config_int( "lease_commit_delay", 0 );
+	if ( delay <= 0 )
+		return false;
+
+	static std::once_flag started;
+	std::call_once( started, [=]() { std::thread( std::bind( &leaseWriter, delay ) ).detach(); } );
+
+	i.done = false;
+	std::unique_lock<std::mutex> lock( intent_mutex );
+	intents.push_back( &i );
+	intent_condition.notify_one();
+	while ( !i.done )
+		intent_done.wait( lock );
+
+	return true;
+}
+
+////////////////////////////////////////
+
+lease_journal *journal = NULL;
+
+stat_counter journal_writes( "lease_journal_writes" );
+stat_counter journal_flushes( "lease_journal_flushes" );
+stat_counter journal_conflicts( "lease_journal_conflicts" );
+stat_counter journal_backlog( "lease_journal_backlog" );
+
+// Write the journal records to the database, in order.
+void journalFlusher( void )
+{
+	workerStart();
+
+	std::vector<journal_entry> entries;
+	while ( 1 )
+	{
+		entries.clear();
+		journal->pending( entries, 256 );
+
+		try
+		{
+			pooled db;
+			uint64_t done = 0;
+			time_t now = ::time( NULL );
+			for ( const journal_entry &e: entries )
+			{
+				if ( e.acquire )
+				{
+					// Only write the time left on the lease
+					int64_t left = e.stamp + e.time - now;
+					lease_write w = left > 0 ? claimLease( db, e.ip, e.mac, uint32_t( left ) ) : LEASE_DONE;
+					if ( w == LEASE_ERROR )
+						break;
+					if ( w == LEASE_REFUSED )
+					{
+						journal_conflicts.add();
+						logMessage( LOG_WARNING, LOGT_ERROR, "Lease journal: %s already leased in database", ip_string( e.ip ).c_str() );
+					}
+				}
+				else if ( dropLease( db, e.ip, e.any_mac ? NULL : e.mac ) == LEASE_ERROR )
+					break;
+				done = e.serial;
+			}
+
+			if ( done != 0 )
+			{
+				journal->flushed( done );
+				journal_flushes.add();
+			}
+
+			// A write failed part way (lost connection, deadlock, read-only
+			// server...), try the rest again later
+			if ( done != entries.back().serial )
+				std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+		}
+		catch ( std::exception &e )
+		{
+			// Wait out database outages, the records are safe in the journal
+			logMessage( LOG_ERR, LOGT_ERROR, "Lease journal: %s", e.what() );
+			std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+		}
+		journal_backlog.set( journal->backlog() );
+	}
+}
+
+// Put the changes still waiting in the journal over the leases loaded
+// from the database, so the addresses acknowledged before a restart are
+// not given out again.
+void loadJournal( void )
+{
+	if ( journal == NULL )
+		return;
+
+	std::vector<journal_entry> entries;
+	journal->unflushed( entries );
+
+	time_t now = ::time( NULL );
+	for ( const journal_entry &e: entries )
+	{
+		time_t expires = 0;
+		if ( e.acquire )
+		{
+			if ( e.stamp + e.time > now )
+				rememberLease( e.ip, e.mac, e.stamp + e.time );
+		}
+		else if ( e.any_mac || cachedLease( e.ip, e.mac, expires ) )
+			forgetLease( e.ip );
+	}
+
+	if ( !entries.empty() )
+		syslog( LOG_INFO, "Loaded %zu lease changes from the journal", entries.size() );
+}
+
+}
+
+////////////////////////////////////////
+
+void mysql_backend::startLeaseJournal( void )
+{
+	std::string file = configuration["lease_journal"];
+	if ( file.empty() )
+		return;
+
+	// Leases are acknowledged against the in-memory leases, which are
+	// only complete with the snapshot
+	if ( config_int( "snapshot_poll", 1000 ) <= 0 )
+		error( "Invalid configuration: lease_journal needs snapshot_poll > 0" );
+
+	journal = new lease_journal( file, config_int( "lease_journal_size", 65536 ) );
+	std::thread( &journalFlusher ).detach();
+}
+
+////////////////////////////////////////
+
+namespace
+{
+
+enum
+{
+	CHANGE_HOST = 1,
+	CHANGE_OPTIONS = 2,
+	CHANGE_LEASE = 3,
+	CHANGE_POOL = 4
+};
+
+stat_counter snapshot_changes( "snapshot_changes" );
+stat_counter snapshot_swaps( "snapshot_swaps" );
+
+uint64_t last_change = 0;
+
+// Load the unexpired leases into the lease cache.
+void loadLeases( pooled &db )
+{
+	statement &s = prepared( db, "SELECT ip_addr, mac_addr, expiration FROM dhcp_lease WHERE expiration > UNIX_TIMESTAMP()", "usu" );
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+
+	while ( s.fetch() )
+	{
+		std::string mac = s.text( 1 );
+		if ( mac.size() == 6 )
+			rememberLease( htonl( s.number( 0 ) ), reinterpret_cast<const uint8_t *>( mac.data() ), s.number( 2 ) );
+	}
+}
+
+// Load the pools and exclusions into the snapshot.
+void loadPools( pooled &db, host_snapshot &snap )
+{
+	std::vector< std::pair<uint32_t, uint32_t> > pools, exclusions;
+	readPools( db, pools, exclusions );
+	snap.setPools( pools, exclusions );
+}
+
+////////////////////////////////////////
+
+// Apply the changes logged since the last poll.
+void pollChanges( void )
+{
+	pooled db;
+
+	// The current lease rows come with the lease changes, in one query
+	statement &s = prepared( db,
+		"SELECT c.id, c.tbl, c.ip_addr, l.mac_addr, l.expiration FROM dhcp_change c "
+			"LEFT JOIN dhcp_lease l ON c.tbl = 3 AND l.ip_addr = c.ip_addr AND l.expiration > UNIX_TIMESTAMP() "
+			"WHERE c.id > ? ORDER BY c.id LIMIT 10000", "luusu" );
+	s.bind( 0, last_change );
+	if ( !s.execute() )
+		error( std::string( "Error querying mysql: " ) + s.error() );
+
+	std::vector<uint32_t> hosts, options;
+	std::map< uint32_t, std::pair<std::string, uint32_t> > leases;
+	bool pools = false;
+	uint64_t last = last_change;
+	while ( s.fetch() )
+	{
+		last = s.number64( 0 );
+		switch ( s.number( 1 ) )
+		{
+			case CHANGE_HOST: hosts.push_back( htonl( s.number( 2 ) ) ); break;
+			case CHANGE_OPTIONS: options.push_back( htonl( s.number( 2 ) ) ); break;
+			case CHANGE_LEASE: leases[htonl( s.number( 2 ) )] = std::make_pair( s.text( 3 ), s.number( 4 ) ); break;
+			case CHANGE_POOL: pools = true; break;
+		}
+	}
+
+	if ( last == last_change )
+		return;
+
+	snapshot_changes.add( last - last_change );
+
+	// Leases go straight to the lease cache
+	for ( auto &l: leases )
+	{
+		const std::string &mac = l.second.first;
+		if ( mac.size() == 6 )
+			rememberLease( l.first, reinterpret_cast<const uint8_t *>( mac.data() ), l.second.second );
+		else
+			forgetLease( l.first );
+	}
+
+	// Hosts and options go into a new snapshot
+	if ( !hosts.empty() || !options.empty() || pools )
+	{
+		std::shared_ptr<host_snapshot> snap = std::make_shared<host_snapshot>( *currentSnapshot() );
+
+		for ( uint32_t ip: hosts )
+		{
+			statement &h = prepared( db, "SELECT mac_addr FROM dhcp_host WHERE ip_addr = ?", "s" );
+			h.bind( 0, ntohl( ip ) );
+			if ( !h.execute() )
+				error( std::string( "Error querying mysql: " ) + h.error() );
+
+			std::string mac;
+			if ( h.fetch() && ( mac = h.text( 0 ) ).size() == 6 )
+				snap->addHost( ip, mac );
+			else
+				snap->removeHost( ip );
+		}
+
+		// Only the options for the ranges that changed are reloaded
+		std::sort( options.begin(), options.end() );
+		options.erase( std::unique( options.begin(), options.end() ), options.end() );
+		for ( uint32_t from: options )
+		{
+			statement &o = prepared( db, "SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options WHERE ip_addr_from = ?", "uus" );
+			o.bind( 0, ntohl( from ) );
+			if ( !o.execute() )
+				error( std::string( "Error querying mysql: " ) + o.error() );
+
+			std::vector< std::tuple<uint32_t, uint32_t, std::string> > opts;
+			while ( o.fetch() )
+				opts.emplace_back( htonl( o.number( 0 ) ), htonl( o.number( 1 ) ), o.text( 2 ) );
+			snap->replaceOptions( from, opts );
+		}
+
+		if ( pools )
+			loadPools( db, *snap );
+
+		std::atomic_store( &snapshot, std::shared_ptr<const host_snapshot>( snap ) );
+		snapshot_swaps.add();
+		invalidateOptionCache();
+		if ( !hosts.empty() || pools )
+		{
+			std::vector<address_range> dynamic = snap->dynamicRanges();
+			buildPools( dynamic );
+			loadClientFilter( snap->boundMACs(), !dynamic.empty() );
+		}
+	}
+
+	last_change = last;
+}
+
+// Without a snapshot, reload the client filter from the hosts now and then.
+void clientFilterLoader( void )
+{
+	workerStart();
+
+	const std::chrono::seconds interval( std::max( 1, config_int( "client_filter_reload", 60 ) ) );
+	while ( 1 )
+	{
+		try
+		{
+			pooled db;
+
+			std::vector<uint64_t> macs;
+			bool dynamic = false;
+			statement &h = prepared( db, "SELECT DISTINCT mac_addr FROM dhcp_host", "s" );
+			if ( !h.execute() )
+				error( std::string( "Error querying mysql: " ) + h.error() );
+			while ( h.fetch() )
+			{
+				std::string mac = h.text( 0 );
+				if ( mac.size() != 6 )
+					continue;
+				uint64_t m = pack_mac( reinterpret_cast<const uint8_t *>( mac.data() ) );
+				if ( m == 0 )
+					dynamic = true;
+				else
+					macs.push_back( m );
+			}
+
+			statement &p = prepared( db, "SELECT 1 FROM dhcp_pool LIMIT 1", "u" );
+			if ( !p.execute() )
+				error( std::string( "Error querying mysql: " ) + p.error() );
+			while ( p.fetch() )
+				dynamic = true;
+
+			loadClientFilter( macs, dynamic );
+		}
+		catch ( std::exception &e )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Client filter: %s", e.what() );
+		}
+
+		std::this_thread::sleep_for( interval );
+	}
+}
+
+////////////////////////////////////////
+
+void snapshotPoller( int interval )
+{
+	workerStart();
+
+	int polls = 0;
+	while ( 1 )
+	{
+		std::this_thread::sleep_for( std::chrono::milliseconds( interval ) );
+		try
+		{
+			pollChanges();
+
+			// Every server reads the change log, so only drop old changes
+			if ( ++polls % 600 == 0 )
+			{
+				pooled db;
+				if ( mysql_query( db, "DELETE FROM dhcp_change WHERE changed < NOW() - INTERVAL 1 HOUR" ) != 0 )
+					logMessage( LOG_ERR, LOGT_ERROR, "Change log: %s", mysql_error( db ) );
+			}
+		}
+		catch ( std::exception &e )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Change log: %s", e.what() );
+		}
+	}
+}
+
+}
+
+////////////////////////////////////////
+
+void mysql_backend::startSnapshot( void )
+{
+	int interval = config_int( "snapshot_poll", 1000 );
+	if ( interval <= 0 )
+	{
+		std::thread( &clientFilterLoader ).detach();
+		return;
+	}
+
+	// Note the last change before loading, so nothing is missed
+	{
+		pooled db;
+		statement &s = prepared( db, "SELECT COALESCE( MAX( id ), 0 ) FROM dhcp_change", "l" );
+		if ( !s.execute() || !s.fetch() )
+			error( std::string( "Error querying mysql: " ) + s.error() );
+		last_change = s.number64( 0 );
+	}
+
+	std::shared_ptr<host_snapshot> snap = std::make_shared<host_snapshot>();
+
+	std::vector< std::pair<uint32_t, std::string> > hosts;
+	getAllHosts( hosts );
+	for ( auto &h: hosts )
+	{
+		if ( h.second.size() == 6 )
+			snap->addHost( h.first, h.second );
+	}
+
+	std::vector< std::tuple<uint32_t, uint32_t, std::string> > opts;
+	getAllOptions( opts );
+	snap->setOptions( opts );
+
+	{
+		pooled db;
+		loadPools( db, *snap );
+		std::vector<address_range> dynamic = snap->dynamicRanges();
+		buildPools( dynamic );
+		loadClientFilter( snap->boundMACs(), !dynamic.empty() );
+		loadLeases( db );
+		loadJournal();
+	}
+
+	std::atomic_store( &snapshot, std::shared_ptr<const host_snapshot>( snap ) );
+	syslog( LOG_INFO, "Loaded %zu hosts and %zu options", hosts.size(), opts.size() );
+
+	std::thread( std::bind( &snapshotPoller, interval ) ).detach();
+}
+
+////////////////////////////////////////
+
+namespace
+{
+
+stat_counter sweep_expired( "lease_sweep_expired" );
+stat_counter sweep_deleted( "lease_sweep_deleted" );
+stat_counter sweep_rate( "lease_sweep_rate" );
+stat_counter sweep_backlog( "lease_sweep_backlog" );
+stat_counter sweep_timers( "lease_sweep_timers" );
+
+// Delete the rows of the expired leases (unless they were renewed).
+// Returns the number of rows deleted.
+uint64_t deleteExpired( pooled &db, const std::vector<uint32_t> &ips )
+{
+	std::string list;
+	for ( uint32_t ip: ips )
+	{
+		if ( !list.empty() )
+			list.push_back( ',' );
+		list += format( "{0}", ntohl( ip ) );
+	}
+
+	std::string query = format( "DELETE FROM dhcp_lease WHERE ip_addr IN ( {0} ) AND expiration <= UNIX_TIMESTAMP()", list );
+	if ( mysql_query( db, query.c_str() ) != 0 )
+		error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+	return mysql_affected_rows( db );
+}
+
+// Expire the leases and offers held in memory every second, and delete
+// the expired lease rows, at most rate rows a second.
+void leaseSweeper( int rate )
+{
+	workerStart();
+
+	const size_t batch = 100;
+	std::deque<uint32_t> backlog;
+	std::vector<uint64_t> deleted( 60, 0 );
+	uint64_t ticks = 0;
+
+	while ( 1 )
+	{
+		std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+		++ticks;
+
+		expireOffers();
+
+		std::vector<uint32_t> expired;
+		expireLeases( time( NULL ), expired );
+		sweep_expired.add( expired.size() );
+		if ( rate > 0 )
+			backlog.insert( backlog.end(), expired.begin(), expired.end() );
+
+		uint64_t count = 0;
+		try
+		{
+			if ( !backlog.empty() )
+			{
+				pooled db;
+				size_t todo = std::min<size_t>( backlog.size(), rate );
+				while ( todo > 0 )
+				{
+					size_t n = std::min( todo, batch );
+					std::vector<uint32_t> ips( backlog.begin(), backlog.begin() + n );
+					count += deleteExpired( db, ips );
+					backlog.erase( backlog.begin(), backlog.begin() + n );
+					todo -= n;
+				}
+			}
+			else if ( rate > 0 && ticks % 60 == 0 )
+			{
+				// Rows this server never saw (from other servers,
+				// or from before it started)
+				pooled db;
+				std::string query = format( "DELETE FROM dhcp_lease WHERE expiration <= UNIX_TIMESTAMP() LIMIT {0}", rate );
+				if ( mysql_query( db, query.c_str() ) != 0 )
+					error( std::string( "Error querying mysql: " ) + mysql_error( db ) );
+				count += mysql_affected_rows( db );
+			}
+		}
+		catch ( std::exception &e )
+		{
+			logMessage( LOG_ERR, LOGT_ERROR, "Lease sweep: %s", e.what() );
+		}
+
+		// The rate is the rows deleted over the last minute
+		deleted[ticks % deleted.size()] = count;
+		sweep_deleted.add( count );
+		sweep_rate.set( std::accumulate( deleted.begin(), deleted.end(), uint64_t( 0 ) ) );
+		sweep_backlog.set( backlog.size() );
+		sweep_timers.set( leaseTimers() );
+	}
+}
+
+}
+
+////////////////////////////////////////
+
+void mysql_backend::startLeaseSweeper( void )
+{
+	int rate = config_int( "lease_sweep_rate", 100 );
+	std::thread( std::bind( &leaseSweeper, std::max( 0, rate ) ) ).detach();
+}
+
+////////////////////////////////////////
+
+bool mysql_backend::acquireLease( uint32_t ip, const uint8_t *hwaddr, uint32_t time )
+{
+	lease_intent i;
+	i.acquire = true;
+	i.ip = ip;
+	memcpy( i.mac, hwaddr, 6 );
+	i.any_mac = false;
+	i.time = time;
+
+	if ( journal && !leaseHeld( ip, hwaddr ) && journal->append( true, ip, hwaddr, time ) )
+	{
+		journal_writes.add();
+		i.result = true;
+	}
+	else if ( !groupCommit( i ) )
+	{
+		pooled db;
+		i.result = ( claimLease( db, ip, hwaddr, time ) == LEASE_DONE );
+	}
+
+	if ( i.result )
+	{
+		logMessage( LOG_DEBUG, LOGT_LEASE, "Acquired lease: %u", time );
+		rememberLease( ip, hwaddr, ::time( NULL ) + time );
+	}
+	return i.result;
+}
+
+////////////////////////////////////////
+
+bool mysql_backend::releaseLease( uint32_t ip, const uint8_t *hwaddr )
+{
+	lease_intent i;
+	i.acquire = false;
+	i.ip = ip;
+	memset( i.mac, 0, 6 );
+	if ( hwaddr )
+		memcpy( i.mac, hwaddr, 6 );
+	i.any_mac = ( hwaddr == NULL );
+	i.time = 0;
+
+	if ( journal && journal->append( false, ip, hwaddr, 0 ) )
+	{
+		journal_writes.add();
+		i.result = true;
+	}
+	else if ( !groupCommit( i ) )
+	{
+		pooled db;
+		i.result = ( dropLease( db, ip, hwaddr ) == LEASE_DONE );
+	}
+
+	if ( i.result )
+		forgetLease( ip );
+	return i.result;
+}
+
+////////////////////////////////////////
@@ -0,0 +1,70 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include "backend.h"
+
+////////////////////////////////////////
+
+// The backend storing everything in a MySQL database.  Hosts, options
+// and leases can be kept in memory and current from the change log
+// (snapshot_poll), and lease writes can go through a journal.
+class mysql_backend : public backend
+{
+public:
+	void threadStart( void ) override;
+	void threadStop( void ) override;
+
+	void startLeaseJournal( void ) override;
+	void startSnapshot( void ) override;
+	void startLeaseSweeper( void ) override;
+
+	int schemaVersion( void ) override;
+	void migrateSchema( void ) override;
+
+	void getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases ) override;
+	void getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts ) override;
+	void getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options ) override;
+
+	std::vector<uint32_t> getIPAddresses( const uint8_t *mac, bool avail ) override;
+	std::vector<std::string> getMACAddresses( uint32_t ip ) override;
+	bool addressAvailable( uint32_t ip, const uint8_t *mac ) override;
+	void getOptions( uint32_t ip, std::vector<std::string> &options ) override;
+
+	void addHost( uint32_t ip, const uint8_t *mac ) override;
+	void removeHost( uint32_t ip ) override;
+
+	void addOption( uint32_t ip1, uint32_t ip2, const std::string &option, bool replace ) override;
+	void removeOption( uint32_t ip1, uint32_t ip2, const std::string &option ) override;
+
+	void getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions ) override;
+	void addPool( uint32_t ip1, uint32_t ip2, bool exclusion ) override;
+	void removePool( uint32_t ip1, uint32_t ip2, bool exclusion ) override;
+
+	bool acquireLease( uint32_t ip, const uint8_t *mac, uint32_t time ) override;
+	bool releaseLease( uint32_t ip, const uint8_t *mac ) override;
+};
+
+////////////////////////////////////////
+
@@ -0,0 +1,198 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#include "native_backend.h"
+#include "address_pool.h"
+#include "config.h"
+#include "error.h"
+#include "lease_cache.h"
+#include "lookup.h"
+#include "offer_table.h"
+#include "stats.h"
+
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	// Free dynamic addresses returned for a client to choose from
+	const size_t free_candidates = 8;
+
+	stat_counter native_leases( "native_leases" );
+	stat_counter native_expired( "native_leases_expired" );
+	stat_counter native_outside( "native_leases_outside" );
+
+	// Parse the network (address/prefix) of the lease store.
+	void parseNetwork( const std::string &str, uint32_t &network, int &prefix )
+	{
+		size_t slash = str.find( '/' );
+		struct in_addr addr;
+		if ( slash == std::string::npos || inet_pton( AF_INET, str.substr( 0, slash ).c_str(), &addr ) != 1 )
+			error( "Invalid configuration of lease_store_network" );
+		network = addr.s_addr;
+		prefix = atoi( str.c_str() + slash + 1 );
+	}
+}
+
+////////////////////////////////////////
+
+native_backend::native_backend( void )
+	: _store_file( configuration["lease_store_file"] )
+{
+	if ( _store_file.empty() )
+		error( "Invalid configuration of lease_store_file" );
+	parseNetwork( configuration["lease_store_network"], _store_network, _store_prefix );
+}
+
+////////////////////////////////////////
+
+lease_store &native_backend::store( void )
+{
+	std::call_once( _opened, [this]()
+	{
+		_store.reset( new lease_store( _store_file, _store_network, _store_prefix, config_int( "lease_store_log_size", 262144 ) ) );
+
+		// Give the pools the leases kept from the last run
+		_store->forEach( []( uint32_t ip, const uint8_t *mac, time_t expires )
+		{
+			rememberLease( ip, mac, expires );
+		} );
+		syslog( LOG_INFO, "Loaded %zu leases", _store->size() );
+	} );
+	return *_store;
+}
+
+////////////////////////////////////////
+
+void native_backend::startSnapshot( void )
+{
+	store();
+}
+
+////////////////////////////////////////
+
+void native_backend::startLeaseSweeper( void )
+{
+	std::thread( &native_backend::sweeper, this ).detach();
+}
+
+////////////////////////////////////////
+
+void native_backend::getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases )
+{
+	store().forEach( [&]( uint32_t ip, const uint8_t *mac, time_t expires )
+	{
+		struct tm tm;
+		char expire[32];
+		strftime( expire, sizeof( expire ), "%Y-%m-%dT%T", localtime_r( &expires, &tm ) );
+		leases.emplace_back( ip, std::string( reinterpret_cast<const char *>( mac ), 6 ), expire );
+	} );
+}
+
+////////////////////////////////////////
+
+std::vector<uint32_t> native_backend::getIPAddresses( const uint8_t *mac, bool avail )
+{
+	if ( !avail )
+		return memory_backend::getIPAddresses( mac, avail );
+
+	// The client's own addresses, its current dynamic address, then a few
+	// free dynamic ones
+	std::vector<uint32_t> ret = current()->getStaticAddresses( mac );
+	ret.erase( std::remove_if( ret.begin(), ret.end(), [=]( uint32_t ip ) { return leaseHeld( ip, mac ); } ), ret.end() );
+
+	uint32_t ip = store().leased( mac );
+	if ( ip != 0 && std::find( ret.begin(), ret.end(), ip ) == ret.end() && poolAvailable( ip, mac ) )
+		ret.push_back( ip );
+
+	freeAddresses( ret, free_candidates, mac );
+	return ret;
+}
+
+////////////////////////////////////////
+
+bool native_backend::acquireLease( uint32_t ip, const uint8_t *mac, uint32_t time )
+{
+	if ( !store().covers( ip ) )
+	{
+		native_outside.add();
+		syslog( LOG_WARNING, "Address %s is outside lease_store_network", ip_string( ip ).c_str() );
+		return false;
+	}
+
+	time_t expires = 0;
+	if ( !store().acquire( ip, mac, time, expires ) )
+		return false;
+
+	rememberLease( ip, mac, expires );
+	return true;
+}
+
+////////////////////////////////////////
+
+bool native_backend::releaseLease( uint32_t ip, const uint8_t *mac )
+{
+	if ( !store().release( ip, mac ) )
+		return false;
+
+	forgetLease( ip );
+	return true;
+}
+
+////////////////////////////////////////
+
+bool native_backend::leaseHeld( uint32_t ip, const uint8_t *mac )
+{
+	return store().held( ip, mac );
+}
+
+////////////////////////////////////////
+
+void native_backend::sweeper( void )
+{
+	while ( 1 )
+	{
+		std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+
+		expireOffers();
+		reload();
+
+		time_t now = ::time( NULL );
+		std::vector<uint32_t> expired;
+		expireLeases( now, expired );
+		native_expired.add( store().expire( expired, now ) );
+
+		store().checkpoint();
+		native_leases.set( store().size() );
+	}
+}
+
+////////////////////////////////////////
+
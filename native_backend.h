@@ -0,0 +1,77 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "lease_store.h"
+#include "memory_backend.h"
+
+////////////////////////////////////////
+
+// The backend for a server that stands alone with many clients.  The
+// hosts, options and pools are kept as by the memory backend, and the
+// leases in a lease store (lease_store_file) with a record for each
+// address of lease_store_network, so they are kept across restarts.
+// The store is opened when the leases are first needed, and only one
+// process can have it open: with the server running, the commands on
+// the leases fail rather than change the store behind it.
+class native_backend : public memory_backend
+{
+public:
+	native_backend( void );
+
+	void startSnapshot( void ) override;
+	void startLeaseSweeper( void ) override;
+
+	void getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases ) override;
+
+	std::vector<uint32_t> getIPAddresses( const uint8_t *mac, bool avail ) override;
+
+	bool acquireLease( uint32_t ip, const uint8_t *mac, uint32_t time ) override;
+	bool releaseLease( uint32_t ip, const uint8_t *mac ) override;
+
+protected:
+	bool leaseHeld( uint32_t ip, const uint8_t *mac ) override;
+
+private:
+	// Expire the leases and offers, and checkpoint the store, every second.
+	void sweeper( void );
+
+	// The lease store, opened (and its leases given to the pools) when
+	// first used.
+	lease_store &store( void );
+
+	std::string _store_file;
+	uint32_t _store_network = 0;
+	int _store_prefix = 0;
+	std::once_flag _opened;
+	std::unique_ptr<lease_store> _store;
+};
+
+////////////////////////////////////////
+
@@ -0,0 +1,182 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "offer_table.h"
+#include "config.h"
+#include "stats.h"
+#include "flat_map.h"
+#include "timer_wheel.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <mutex>
+
+namespace
+{
+	typedef std::chrono::steady_clock offer_clock;
+
+	struct offer
+	{
+		uint32_t ip;
+		uint32_t xid;
+		offer_clock::time_point expires;
+	};
+
+	std::mutex offer_mutex;
+	flat_map<uint64_t,offer> offers;
+	flat_map<uint32_t,uint64_t> held;
+
+	time_t seconds( offer_clock::time_point t )
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>( t.time_since_epoch() ).count();
+	}
+
+	timer_wheel timers( seconds( offer_clock::now() ) );
+
+	stat_counter reserved( "offers_reserved" );
+	stat_counter conflicts( "offers_conflicts" );
+
+	std::chrono::seconds offerTimeout( void )
+	{
+		static const std::chrono::seconds timeout( config_int( "offer_timeout", 30 ) );
+		return timeout;
+	}
+
+	// Remove the offer to the client (with the table locked).
+	void remove( uint64_t mac )
+	{
+		offer *o = offers.find( mac );
+		if ( o == NULL )
+			return;
+
+		uint64_t *h = held.find( o->ip );
+		if ( h && *h == mac )
+			held.erase( o->ip );
+		offers.erase( mac );
+	}
+
+	// Remove all expired offers (with the table locked).
+	void expire( offer_clock::time_point now )
+	{
+		offers.erase_if( [&]( uint64_t, const offer &o )
+		{
+			if ( o.expires > now )
+				return false;
+			held.erase( o.ip );
+			return true;
+		} );
+	}
+
+	// Check if the IP is held by another client (with the table locked).
+	bool isHeld( uint32_t ip, uint64_t mac, offer_clock::time_point now )
+	{
+		uint64_t *h = held.find( ip );
+		if ( h == NULL || *h == mac )
+			return false;
+
+		uint64_t other = *h;
+		offer *o = offers.find( other );
+		if ( o == NULL || o->expires <= now )
+		{
+			remove( other );
+			held.erase( ip );
+			return false;
+		}
+
+		return true;
+	}
+}
+
+////////////////////////////////////////
+
+bool reserveOffer( const uint8_t *mac, uint32_t xid, uint32_t ip )
+{
+	uint64_t key = pack_mac( mac );
+	offer_clock::time_point now = offer_clock::now();
+
+	std::unique_lock<std::mutex> lock( offer_mutex );
+
+	// Keep the table from growing with clients that never come back.
+	if ( offers.size() > 4096 )
+		expire( now );
+
+	if ( isHeld( ip, key, now ) )
+	{
+		conflicts.add();
+		return false;
+	}
+
+	remove( key );
+	offers[key] = offer { ip, xid, now + offerTimeout() };
+	held[ip] = key;
+	timers.schedule( key, seconds( now + offerTimeout() ) + 1 );
+	reserved.add();
+	return true;
+}
+
+////////////////////////////////////////
+
+uint32_t findOffer( const uint8_t *mac, uint32_t xid )
+{
+	std::unique_lock<std::mutex> lock( offer_mutex );
+	const offer *o = offers.find( pack_mac( mac ) );
+	if ( o == NULL || o->xid != xid || o->expires <= offer_clock::now() )
+		return 0;
+	return o->ip;
+}
+
+////////////////////////////////////////
+
+bool offerHeld( uint32_t ip, const uint8_t *mac )
+{
+	std::unique_lock<std::mutex> lock( offer_mutex );
+	return isHeld( ip, pack_mac( mac ), offer_clock::now() );
+}
+
+////////////////////////////////////////
+
+void releaseOffer( const uint8_t *mac )
+{
+	std::unique_lock<std::mutex> lock( offer_mutex );
+	remove( pack_mac( mac ) );
+}
+
+////////////////////////////////////////
+
+void expireOffers( void )
+{
+	offer_clock::time_point now = offer_clock::now();
+	std::vector<uint64_t> due;
+
+	std::unique_lock<std::mutex> lock( offer_mutex );
+	timers.advance( seconds( now ), due );
+	for ( uint64_t mac: due )
+	{
+		const offer *o = offers.find( mac );
+		if ( o != NULL && o->expires <= now )
+			remove( mac );
+	}
+}
+
+////////////////////////////////////////
@@ -0,0 +1,52 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+
+////////////////////////////////////////
+
+// Addresses offered to clients are held for offer_timeout seconds, so
+// the REQUEST that follows an OFFER can be confirmed without querying
+// the database again, and concurrent DISCOVERs get different addresses.
+// A client holds at most one offer.
+
+// Reserve the IP for the client transaction (replacing any earlier offer
+// to the client).  Returns false if the IP is held by another client.
+bool reserveOffer( const uint8_t *mac, uint32_t xid, uint32_t ip );
+
+// Get the IP offered to the client in the transaction (0 if none).
+uint32_t findOffer( const uint8_t *mac, uint32_t xid );
+
+// Check if the IP is held by an offer to another client.
+bool offerHeld( uint32_t ip, const uint8_t *mac );
+
+// Forget the offer to the client.
+void releaseOffer( const uint8_t *mac );
+
+// Forget the offers that have timed out.
+void expireOffers( void );
+
+////////////////////////////////////////
+
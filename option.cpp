@@ -114,7 +114,10 @@ std::string parse_option( const std::string &opt )
 	int o = dhcp_options[name];
 	std::vector<Type> argtypes = dhcp_args[o];
 
-	if ( argtypes.back() == TYPE_MORE )
+	if ( argtypes.empty() && args.size() == 1 && args[0].empty() )
+		args.clear();
+
+	if ( !argtypes.empty() && argtypes.back() == TYPE_MORE )
 	{
 		argtypes.pop_back();
 		while ( argtypes.size() < args.size() )
@@ -0,0 +1,172 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "option_cache.h"
+#include "backend.h"
+#include "config.h"
+#include "packet.h"
+#include "reply_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+	typedef std::chrono::steady_clock cache_clock;
+
+	struct cache_entry
+	{
+		std::shared_ptr<const option_block> block;
+		cache_clock::time_point expires;
+	};
+
+	std::mutex cache_mutex;
+	std::unordered_map<uint32_t,cache_entry> cache;
+
+	// Bumped on each invalidation, so that blocks loaded
+	// while the options were changing are not cached.
+	uint64_t generation = 0;
+
+	uint32_t timeValue( const std::string &o )
+	{
+		uint32_t t = 0;
+		if ( o.size() == 6 )
+		{
+			for ( int i = 2; i < 6; ++i )
+				t = ( t << 8 ) + uint8_t( o[i] );
+		}
+		return t;
+	}
+
+	std::shared_ptr<const option_block> loadOptionBlock( uint32_t ip )
+	{
+		std::vector<std::string> tmp;
+		getOptions( ip, tmp );
+
+		auto block = std::make_shared<option_block>();
+		for ( std::string &o: tmp )
+		{
+			if ( o.empty() )
+				continue;
+
+			switch ( uint8_t( o[0] ) )
+			{
+				case DOP_HOSTNAME:
+					block->hostname = o;
+					break;
+
+				case DOP_IP_ADDRESS_LEASETIME:
+					block->lease = o;
+					block->lease_time = timeValue( o );
+					break;
+
+				case DOP_RENEWAL_TIMEVALUE:
+					block->renewal_time = timeValue( o );
+					break;
+
+				case DOP_REBINDING_TIMEVALUE:
+					block->rebinding_time = timeValue( o );
+					break;
+
+				case DOP_SERVER_IDENTIFIER:
+					block->server = o;
+					break;
+
+				case DOP_RAPID_COMMIT:
+					block->rapid_commit = true;
+					break;
+
+				case DOP_TFTP_SERVERNAME:
+					block->tftp_server = o.substr( 2, uint8_t( o[1] ) );
+					break;
+
+				default:
+					block->options.push_back( o );
+					break;
+			}
+		}
+
+		if ( block->renewal_time == 0 || block->renewal_time > block->lease_time )
+			block->renewal_time = block->lease_time / 2;
+		if ( block->rebinding_time == 0 || block->rebinding_time > block->lease_time )
+			block->rebinding_time = uint64_t( block->lease_time ) * 7 / 8;
+
+		std::sort( block->options.begin(), block->options.end() );
+		return block;
+	}
+}
+
+////////////////////////////////////////
+
+void option_block::requested( const std::bitset<256> &req, std::vector<std::string> &opts ) const
+{
+	for ( const std::string &o: options )
+	{
+		if ( req.test( uint8_t( o[0] ) ) )
+			opts.push_back( o );
+	}
+}
+
+////////////////////////////////////////
+
+std::shared_ptr<const option_block> getOptionBlock( uint32_t ip )
+{
+	static const int ttl = config_int( "option_cache_ttl", 60 );
+	if ( ttl <= 0 )
+		return loadOptionBlock( ip );
+
+	cache_clock::time_point now = cache_clock::now();
+	uint64_t gen = 0;
+	{
+		std::unique_lock<std::mutex> lock( cache_mutex );
+		auto e = cache.find( ip );
+		if ( e != cache.end() && e->second.expires > now )
+			return e->second.block;
+		gen = generation;
+	}
+
+	std::shared_ptr<const option_block> block = loadOptionBlock( ip );
+
+	std::unique_lock<std::mutex> lock( cache_mutex );
+	if ( gen == generation )
+		cache[ip] = cache_entry { block, now + std::chrono::seconds( ttl ) };
+	return block;
+}
+
+////////////////////////////////////////
+
+void invalidateOptionCache( void )
+{
+	std::unique_lock<std::mutex> lock( cache_mutex );
+	cache.clear();
+	++generation;
+	lock.unlock();
+
+	// Cached replies were built from the old options.
+	invalidateReplyCache();
+}
+
+////////////////////////////////////////
+
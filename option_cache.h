@@ -0,0 +1,73 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <bitset>
+#include <memory>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////
+
+// All the options configured for an IP address, merged and encoded.
+// The options needing special treatment in a reply are split out.
+struct option_block
+{
+	std::string hostname;
+	std::string lease;
+	std::string server;
+
+	// The lease time in seconds (0 when not configured).
+	uint32_t lease_time = 0;
+
+	// The renewal (T1) and rebinding (T2) times for the full lease time,
+	// as configured or else the RFC 2131 defaults of 1/2 and 7/8.
+	uint32_t renewal_time = 0;
+	uint32_t rebinding_time = 0;
+
+	// Rapid commit (RFC 4039) is allowed for the address.
+	bool rapid_commit = false;
+
+	// The TFTP server name (empty when none), resolved in the background
+	// when replying.
+	std::string tftp_server;
+
+	// Every other option, in wire format and sorted by option code.
+	std::vector<std::string> options;
+
+	// Append the options that the client asked for.
+	void requested( const std::bitset<256> &req, std::vector<std::string> &opts ) const;
+};
+
+////////////////////////////////////////
+
+// Get the (cached) options for the given IP.
+std::shared_ptr<const option_block> getOptionBlock( uint32_t ip );
+
+// Drop all cached options (call after the options have changed).
+void invalidateOptionCache( void );
+
+////////////////////////////////////////
+
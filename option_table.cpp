@@ -0,0 +1,198 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#include "option_table.h"
+
+#include <algorithm>
+
+namespace
+{
+	uint8_t code( const option_range *r )
+	{
+		return uint8_t( r->option[0] );
+	}
+
+	uint32_t width( const option_range *r )
+	{
+		return r->to - r->from;
+	}
+
+	bool sameList( const std::shared_ptr<const std::vector<std::string> > &a, const std::shared_ptr<const std::vector<std::string> > &b )
+	{
+		if ( a == b )
+			return true;
+		if ( !a || !b )
+			return false;
+		return *a == *b;
+	}
+}
+
+////////////////////////////////////////
+
+void mergeOptions( const std::vector<const option_range *> &rows, std::vector<std::string> &options )
+{
+	std::vector<const option_range *> sorted;
+	for ( const option_range *r: rows )
+	{
+		if ( !r->option.empty() )
+			sorted.push_back( r );
+	}
+
+	// By code, then the smallest range (the later one for a tie)
+	std::sort( sorted.begin(), sorted.end(), []( const option_range *a, const option_range *b )
+	{
+		if ( code( a ) != code( b ) )
+			return code( a ) < code( b );
+		if ( width( a ) != width( b ) )
+			return width( a ) < width( b );
+		if ( a->from != b->from )
+			return a->from > b->from;
+		return a->option < b->option;
+	} );
+
+	for ( size_t i = 0; i < sorted.size(); )
+	{
+		const option_range *best = sorted[i];
+		for ( ; i < sorted.size() && code( sorted[i] ) == code( best ); ++i )
+		{
+			if ( sorted[i]->from == best->from && sorted[i]->to == best->to )
+				options.push_back( sorted[i]->option );
+		}
+	}
+}
+
+////////////////////////////////////////
+
+option_table::option_table( void )
+	: _segments( 1, segment { 0, option_list() } )
+{
+}
+
+////////////////////////////////////////
+
+void option_table::assign( std::vector<option_range> rows )
+{
+	std::stable_sort( rows.begin(), rows.end(), []( const option_range &a, const option_range &b ) { return a.from < b.from; } );
+	_rows.swap( rows );
+
+	_segments.clear();
+	build( 0, 0xFFFFFFFF, _segments );
+}
+
+////////////////////////////////////////
+
+void option_table::replace( uint32_t from, const std::vector<option_range> &rows )
+{
+	// The addresses covered by the old and the new rows
+	uint64_t lo = from, hi = from;
+	auto first = std::lower_bound( _rows.begin(), _rows.end(), from, []( const option_range &r, uint32_t f ) { return r.from < f; } );
+	auto last = first;
+	for ( ; last != _rows.end() && last->from == from; ++last )
+		hi = std::max<uint64_t>( hi, last->to );
+	first = _rows.erase( first, last );
+
+	for ( const option_range &r: rows )
+		hi = std::max<uint64_t>( hi, r.to );
+	_rows.insert( first, rows.begin(), rows.end() );
+
+	// Keep the segments before and after the covered addresses
+	auto after = []( uint64_t ip, const segment &s ) { return ip < s.start; };
+	size_t i = std::upper_bound( _segments.begin(), _segments.end(), lo, after ) - _segments.begin() - 1;
+	size_t j = std::upper_bound( _segments.begin(), _segments.end(), hi + 1, after ) - _segments.begin() - 1;
+
+	std::vector<segment> segs( _segments.begin(), _segments.begin() + i );
+	if ( _segments[i].start < lo )
+		append( segs, _segments[i] );
+	build( lo, hi, segs );
+	if ( hi < 0xFFFFFFFF )
+	{
+		append( segs, segment { uint32_t( hi + 1 ), _segments[j].options } );
+		for ( size_t k = j + 1; k < _segments.size(); ++k )
+			append( segs, _segments[k] );
+	}
+	_segments.swap( segs );
+}
+
+////////////////////////////////////////
+
+void option_table::lookup( uint32_t ip, std::vector<std::string> &options ) const
+{
+	auto s = std::upper_bound( _segments.begin(), _segments.end(), ip, []( uint32_t i, const segment &s ) { return i < s.start; } );
+	--s;
+	if ( s->options )
+		options.insert( options.end(), s->options->begin(), s->options->end() );
+}
+
+////////////////////////////////////////
+
+void option_table::build( uint64_t lo, uint64_t hi, std::vector<segment> &out ) const
+{
+	// The rows touching the addresses, and where the segments start
+	std::vector<const option_range *> rows;
+	std::vector<uint64_t> starts( 1, lo );
+	for ( const option_range &r: _rows )
+	{
+		if ( r.from > hi )
+			break;
+		if ( r.to < lo )
+			continue;
+		rows.push_back( &r );
+		if ( r.from > lo )
+			starts.push_back( r.from );
+		if ( uint64_t( r.to ) < hi )
+			starts.push_back( uint64_t( r.to ) + 1 );
+	}
+	std::sort( starts.begin(), starts.end() );
+	starts.erase( std::unique( starts.begin(), starts.end() ), starts.end() );
+
+	// Sweep through the segments, keeping the rows covering each one
+	std::vector<const option_range *> active;
+	size_t next = 0;
+	for ( uint64_t start: starts )
+	{
+		active.erase( std::remove_if( active.begin(), active.end(), [=]( const option_range *r ) { return r->to < start; } ), active.end() );
+		for ( ; next < rows.size() && rows[next]->from <= start; ++next )
+		{
+			if ( rows[next]->to >= start )
+				active.push_back( rows[next] );
+		}
+
+		auto opts = std::make_shared<std::vector<std::string> >();
+		mergeOptions( active, *opts );
+		std::sort( opts->begin(), opts->end() );
+		append( out, segment { uint32_t( start ), opts->empty() ? option_list() : opts } );
+	}
+}
+
+////////////////////////////////////////
+
+void option_table::append( std::vector<segment> &segs, const segment &s )
+{
+	// Neighbours with the same options are one segment
+	if ( segs.empty() || !sameList( segs.back().options, s.options ) )
+		segs.push_back( s );
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,88 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////
+
+// An option configured for a range of addresses (host order).
+struct option_range
+{
+	uint32_t from, to;
+	std::string option;
+};
+
+// Append the options of the given rows (all covering one address) to the list.
+// For each option code only the rows of the smallest range are used.
+void mergeOptions( const std::vector<const option_range *> &rows, std::vector<std::string> &options );
+
+////////////////////////////////////////
+
+// The option ranges compiled into sorted segments that do not overlap,
+// each with the merged options for its addresses, so that finding the
+// options for an address is a binary search.
+class option_table
+{
+public:
+	option_table( void );
+
+	// Replace all of the rows.
+	void assign( std::vector<option_range> rows );
+
+	// Replace the rows whose range starts at from, rebuilding only the
+	// segments covered by the old and new rows.
+	void replace( uint32_t from, const std::vector<option_range> &rows );
+
+	// Append the options for the address (host order).
+	void lookup( uint32_t ip, std::vector<std::string> &options ) const;
+
+	size_t segments( void ) const
+	{
+		return _segments.size();
+	}
+
+private:
+	typedef std::shared_ptr<const std::vector<std::string> > option_list;
+
+	// A segment runs from its start to the start of the next one.
+	struct segment
+	{
+		uint32_t start;
+		option_list options;
+	};
+
+	void build( uint64_t lo, uint64_t hi, std::vector<segment> &out ) const;
+	static void append( std::vector<segment> &segs, const segment &s );
+
+	// Sorted by the start of the range.
+	std::vector<option_range> _rows;
+	std::vector<segment> _segments;
+};
+
+////////////////////////////////////////
+
@@ -128,6 +128,7 @@ enum Option
 	DOP_DEFAULT_IRC_SERVER = 74,
 	DOP_STREET_TALK_SERVER = 75,
 	DOP_STDA_SERVER = 76,
+	DOP_RAPID_COMMIT = 80,
 	DOP_CLIENT_SYSTEM_ARCH = 93,
 	DOP_NETWORK_DEVICE_INTERFACE = 94,
 	DOP_UNIQUE_CLIENT_ID = 97,
@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "reply_cache.h"
+#include "packet.h"
+#include "config.h"
+#include "stats.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace
+{
+	typedef std::chrono::steady_clock cache_clock;
+
+	struct cache_entry
+	{
+		packet reply;
+		cache_clock::time_point expires;
+	};
+
+	std::mutex cache_mutex;
+	std::unordered_map<std::string,std::unique_ptr<cache_entry>> cache;
+
+	stat_counter hits( "reply_cache_hits" );
+	stat_counter misses( "reply_cache_misses" );
+
+	int cacheTTL( void )
+	{
+		static const int ttl = config_int( "reply_cache_ttl", 30 );
+		return ttl;
+	}
+
+	std::string cacheKey( const packet *p, uint32_t ip, uint32_t server_ip, const std::string &prl, bool rapid )
+	{
+		std::string key( reinterpret_cast<const char*>( p->chaddr ), 6 );
+		key.append( reinterpret_cast<const char*>( &ip ), 4 );
+		key.append( reinterpret_cast<const char*>( &server_ip ), 4 );
+		key.push_back( rapid ? 1 : 0 );
+		key.append( prl );
+		return key;
+	}
+
+	// The message type is always the first option in our replies.
+	bool hasMessageType( const packet *reply )
+	{
+		const uint8_t *o = reply->options;
+		return o[0] == 0x63 && o[1] == 0x82 && o[2] == 0x53 && o[3] == 0x63 &&
+			o[4] == DOP_DHCP_MESSAGE_TYPE && o[5] == 1;
+	}
+
+	void removeExpired( cache_clock::time_point now )
+	{
+		for ( auto i = cache.begin(); i != cache.end(); )
+		{
+			if ( i->second->expires <= now )
+				i = cache.erase( i );
+			else
+				++i;
+		}
+	}
+}
+
+////////////////////////////////////////
+
+bool findReply( const packet *p, uint32_t ip, uint32_t server_ip, const std::string &prl, bool rapid, uint8_t type, packet *reply )
+{
+	if ( cacheTTL() <= 0 )
+		return false;
+
+	std::string key = cacheKey( p, ip, server_ip, prl, rapid );
+	{
+		std::unique_lock<std::mutex> lock( cache_mutex );
+		auto e = cache.find( key );
+		if ( e == cache.end() || e->second->expires <= cache_clock::now() )
+		{
+			misses.add();
+			return false;
+		}
+		memcpy( reply, &e->second->reply, sizeof(packet) );
+	}
+
+	hits.add();
+	reply->xid = p->xid;
+	reply->flags = p->flags;
+	reply->options[6] = type;
+	return true;
+}
+
+////////////////////////////////////////
+
+void storeReply( const packet *p, uint32_t ip, uint32_t server_ip, const std::string &prl, bool rapid, const packet *reply )
+{
+	static const size_t max_size = config_int( "reply_cache_size", 65536 );
+
+	if ( cacheTTL() <= 0 || !hasMessageType( reply ) )
+		return;
+
+	std::unique_ptr<cache_entry> e( new cache_entry );
+	memcpy( &e->reply, reply, sizeof(packet) );
+	cache_clock::time_point now = cache_clock::now();
+	e->expires = now + std::chrono::seconds( cacheTTL() );
+
+	std::string key = cacheKey( p, ip, server_ip, prl, rapid );
+
+	std::unique_lock<std::mutex> lock( cache_mutex );
+	if ( cache.size() >= max_size )
+	{
+		removeExpired( now );
+		if ( cache.size() >= max_size )
+			cache.clear();
+	}
+	cache[key] = std::move( e );
+}
+
+////////////////////////////////////////
+
+void invalidateReplyCache( void )
+{
+	std::unique_lock<std::mutex> lock( cache_mutex );
+	cache.clear();
+}
+
+////////////////////////////////////////
+
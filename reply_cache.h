@@ -0,0 +1,48 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+struct packet;
+
+////////////////////////////////////////
+
+// Replies are cached per client (MAC, offered IP, server, parameter
+// request list and whether rapid commit was used).  A cached reply only differs from a fresh one in the
+// xid, the flags and the DHCP message type.
+
+// Copy the cached reply for the client request into reply, patched for
+// this request.  Returns false if there is no cached reply.
+bool findReply( const packet *p, uint32_t ip, uint32_t server_ip, const std::string &prl, bool rapid, uint8_t type, packet *reply );
+
+// Remember the reply built for the client request.
+void storeReply( const packet *p, uint32_t ip, uint32_t server_ip, const std::string &prl, bool rapid, const packet *reply );
+
+// Drop all cached replies.
+void invalidateReplyCache( void );
+
+////////////////////////////////////////
+
@@ -1,25 +1,93 @@
 
+CREATE TABLE dhcp_schema (
+	version INT UNSIGNED NOT NULL
+);
+
+INSERT INTO dhcp_schema VALUES ( 5 );
+
 CREATE TABLE dhcp_lease (
 	ip_addr INT UNSIGNED NOT NULL,
 	mac_addr BINARY(6) NOT NULL,
-	expiration DATETIME NOT NULL,
+	expiration INT UNSIGNED NOT NULL,
 
-	PRIMARY KEY(ip_addr)
+	PRIMARY KEY(ip_addr),
+	INDEX mac_addr(mac_addr),
+	INDEX expiration(expiration)
 );
 
 CREATE TABLE dhcp_options (
-	id BIGINT UNSIGNED NOT NULL,
+	id BIGINT UNSIGNED NOT NULL AUTO_INCREMENT,
 	ip_addr_from INT UNSIGNED NOT NULL,
 	ip_addr_to INT UNSIGNED NOT NULL,
+	code TINYINT UNSIGNED NOT NULL DEFAULT 0,
 	options VARBINARY(64) NOT NULL,
 
-	PRIMARY KEY(id)
+	PRIMARY KEY(id),
+	INDEX ip_range(ip_addr_from, ip_addr_to, code)
 );
 
 CREATE TABLE dhcp_host (
 	ip_addr INT UNSIGNED NOT NULL,
 	mac_addr BINARY(6) NOT NULL,
 
-	PRIMARY KEY(ip_addr) 
+	PRIMARY KEY(ip_addr),
+	INDEX mac_addr(mac_addr)
 );
 
+-- Ranges of addresses given to any client, less the excluded ranges
+CREATE TABLE dhcp_pool (
+	ip_addr_from INT UNSIGNED NOT NULL,
+	ip_addr_to INT UNSIGNED NOT NULL,
+
+	PRIMARY KEY(ip_addr_from, ip_addr_to)
+);
+
+CREATE TABLE dhcp_exclusion (
+	ip_addr_from INT UNSIGNED NOT NULL,
+	ip_addr_to INT UNSIGNED NOT NULL,
+
+	PRIMARY KEY(ip_addr_from, ip_addr_to)
+);
+
+-- Changes to the tables above, polled by the servers to keep their
+-- in-memory copies current (tbl: 1 = host, 2 = options, 3 = lease, 4 = pool).
+CREATE TABLE dhcp_change (
+	id BIGINT UNSIGNED NOT NULL AUTO_INCREMENT,
+	tbl TINYINT UNSIGNED NOT NULL,
+	ip_addr INT UNSIGNED NOT NULL,
+	changed TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+
+	PRIMARY KEY(id),
+	INDEX changed(changed)
+);
+
+CREATE TRIGGER dhcp_host_insert AFTER INSERT ON dhcp_host FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 1, NEW.ip_addr );
+CREATE TRIGGER dhcp_host_update AFTER UPDATE ON dhcp_host FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 1, OLD.ip_addr ), ( 1, NEW.ip_addr );
+CREATE TRIGGER dhcp_host_delete AFTER DELETE ON dhcp_host FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 1, OLD.ip_addr );
+
+CREATE TRIGGER dhcp_options_insert AFTER INSERT ON dhcp_options FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 2, NEW.ip_addr_from );
+CREATE TRIGGER dhcp_options_update AFTER UPDATE ON dhcp_options FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 2, OLD.ip_addr_from ), ( 2, NEW.ip_addr_from );
+CREATE TRIGGER dhcp_options_delete AFTER DELETE ON dhcp_options FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 2, OLD.ip_addr_from );
+
+CREATE TRIGGER dhcp_lease_insert AFTER INSERT ON dhcp_lease FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 3, NEW.ip_addr );
+CREATE TRIGGER dhcp_lease_update AFTER UPDATE ON dhcp_lease FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 3, NEW.ip_addr );
+CREATE TRIGGER dhcp_lease_delete AFTER DELETE ON dhcp_lease FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 3, OLD.ip_addr );
+
+CREATE TRIGGER dhcp_pool_insert AFTER INSERT ON dhcp_pool FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, NEW.ip_addr_from );
+CREATE TRIGGER dhcp_pool_delete AFTER DELETE ON dhcp_pool FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, OLD.ip_addr_from );
+CREATE TRIGGER dhcp_exclusion_insert AFTER INSERT ON dhcp_exclusion FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, NEW.ip_addr_from );
+CREATE TRIGGER dhcp_exclusion_delete AFTER DELETE ON dhcp_exclusion FOR EACH ROW
+	INSERT INTO dhcp_change ( tbl, ip_addr ) VALUES ( 4, OLD.ip_addr_from );
+
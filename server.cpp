@@ -29,6 +29,9 @@
 #include "packet_queue.h"
 #include "config.h"
 #include "guard.h"
+#include "stats.h"
+#include "log.h"
+#include "backend.h"
 
 #include <stdio.h>
 #include <syslog.h>
@@ -39,6 +42,8 @@
 #include <sys/types.h>
 #include <ifaddrs.h>
 
+#include <chrono>
+#include <functional>
 #include <thread>
 #include <vector>
 
@@ -80,6 +85,17 @@ void serve( uint32_t listen_address, uint32_t server_address )
 		threads[t].join();
 }
 
+////////////////////////////////////////
+
+void statistics( int interval )
+{
+	while ( 1 )
+	{
+		std::this_thread::sleep_for( std::chrono::seconds( interval ) );
+		reportStats();
+	}
+}
+
 }
 
 ////////////////////////////////////////
@@ -97,12 +113,20 @@ int server( const std::string &pidf )
 		openlog( "dhcpdb", LOG_PERROR | LOG_PID, LOG_DAEMON );
 
 		daemonize( "dhcpdb", foreground );
+		startLogging();
+		startLeaseJournal();
+		startSnapshot();
+		startLeaseSweeper();
 
 		if ( !pidf.empty() )
 			pidfile( pidf );
 
 		std::vector<std::thread> threads;
 
+		int stats_interval = config_int( "stats_interval", 300 );
+		if ( stats_interval > 0 )
+			threads.push_back( std::thread( std::bind( &statistics, stats_interval ) ) );
+
 		uint32_t main_ip = INADDR_ANY;
 		if ( configuration.find( "server" ) != configuration.end() )
 		{
@@ -0,0 +1,861 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#include "sqlite_backend.h"
+#include "address_pool.h"
+#include "client_filter.h"
+#include "config.h"
+#include "error.h"
+#include "flat_map.h"
+#include "format.h"
+#include "guard.h"
+#include "lease_cache.h"
+#include "log.h"
+#include "offer_table.h"
+#include "option_cache.h"
+#include "option_table.h"
+#include "stats.h"
+
+#include <arpa/inet.h>
+#include <string.h>
+#include <sqlite3.h>
+#include <syslog.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+	// Free dynamic addresses returned for a client to choose from
+	const size_t free_candidates = 8;
+
+	stat_counter commits( "sqlite_commits" );
+	stat_counter commit_rows( "sqlite_commit_rows" );
+	stat_counter sweep_deleted( "sqlite_sweep_deleted" );
+	stat_counter sweep_backlog( "sqlite_sweep_backlog" );
+
+	const std::string &databaseFile( void )
+	{
+		static const std::string file = configuration["sqlite_file"];
+		if ( file.empty() )
+			error( "Invalid configuration of sqlite_file" );
+		return file;
+	}
+
+	// A connection with its prepared statements.
+	class sqlite_db
+	{
+	public:
+		explicit sqlite_db( const std::string &file )
+			: _db( NULL )
+		{
+			if ( sqlite3_open_v2( file.c_str(), &_db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_NOMUTEX, NULL ) != SQLITE_OK )
+			{
+				std::string msg = _db ? sqlite3_errmsg( _db ) : "out of memory";
+				sqlite3_close( _db );
+				error( format( "Error opening sqlite database {0}: {1}", file, msg ) );
+			}
+
+			sqlite3_busy_timeout( _db, 5000 );
+			exec( "PRAGMA journal_mode = WAL" );
+		}
+
+		~sqlite_db( void )
+		{
+			for ( auto &s: _statements )
+				sqlite3_finalize( s.second );
+			sqlite3_close( _db );
+		}
+
+		operator sqlite3 *( void )
+		{
+			return _db;
+		}
+
+		// Get the prepared statement (kept for the next time).
+		sqlite3_stmt *prepare( const char *sql )
+		{
+			sqlite3_stmt *&s = _statements[sql];
+			if ( s == NULL && sqlite3_prepare_v2( _db, sql, -1, &s, NULL ) != SQLITE_OK )
+				error( format( "Error preparing sqlite: {0}", sqlite3_errmsg( _db ) ) );
+			return s;
+		}
+
+		void exec( const char *sql )
+		{
+			char *msg = NULL;
+			if ( sqlite3_exec( _db, sql, NULL, NULL, &msg ) != SQLITE_OK )
+			{
+				std::string m = msg ? msg : sqlite3_errmsg( _db );
+				sqlite3_free( msg );
+				error( format( "Error querying sqlite: {0}", m ) );
+			}
+		}
+
+	private:
+		sqlite3 *_db;
+		std::map<const char *, sqlite3_stmt *> _statements;
+	};
+
+	// A run of a prepared statement, reset when done.
+	// Parameters and columns count from 0.
+	class query
+	{
+	public:
+		query( sqlite_db &db, const char *sql )
+			: _db( db ), _stmt( db.prepare( sql ) )
+		{
+		}
+
+		~query( void )
+		{
+			sqlite3_reset( _stmt );
+			sqlite3_clear_bindings( _stmt );
+		}
+
+		void bind( int i, uint32_t value )
+		{
+			sqlite3_bind_int64( _stmt, i + 1, value );
+		}
+
+		void bind( int i, int64_t value )
+		{
+			sqlite3_bind_int64( _stmt, i + 1, value );
+		}
+
+		void bind( int i, const void *data, size_t size )
+		{
+			sqlite3_bind_blob( _stmt, i + 1, data, int( size ), SQLITE_TRANSIENT );
+		}
+
+		void bind( int i, const std::string &value )
+		{
+			bind( i, value.data(), value.size() );
+		}
+
+		// Run the statement (the first time) or get the next row.
+		// Returns false when there are no more rows.
+		bool step( void )
+		{
+			int rc = sqlite3_step( _stmt );
+			if ( rc == SQLITE_ROW )
+				return true;
+			if ( rc != SQLITE_DONE )
+				error( format( "Error querying sqlite: {0}", sqlite3_errmsg( _db ) ) );
+			return false;
+		}
+
+		uint32_t number( int col ) const
+		{
+			return uint32_t( sqlite3_column_int64( _stmt, col ) );
+		}
+
+		int64_t number64( int col ) const
+		{
+			return sqlite3_column_int64( _stmt, col );
+		}
+
+		bool null( int col ) const
+		{
+			return sqlite3_column_type( _stmt, col ) == SQLITE_NULL;
+		}
+
+		std::string text( int col ) const
+		{
+			const char *data = static_cast<const char *>( sqlite3_column_blob( _stmt, col ) );
+			return std::string( data ? data : "", sqlite3_column_bytes( _stmt, col ) );
+		}
+
+		int affected( void )
+		{
+			return sqlite3_changes( _db );
+		}
+
+	private:
+		sqlite_db &_db;
+		sqlite3_stmt *_stmt;
+	};
+
+	void createSchema( sqlite_db &db )
+	{
+		db.exec(
+			"CREATE TABLE IF NOT EXISTS dhcp_schema ( version INTEGER NOT NULL );"
+			"CREATE TABLE IF NOT EXISTS dhcp_lease ( ip_addr INTEGER PRIMARY KEY, mac_addr BLOB NOT NULL, expiration INTEGER NOT NULL );"
+			"CREATE INDEX IF NOT EXISTS dhcp_lease_mac ON dhcp_lease ( mac_addr );"
+			"CREATE INDEX IF NOT EXISTS dhcp_lease_expiration ON dhcp_lease ( expiration );"
+			"CREATE TABLE IF NOT EXISTS dhcp_options ( id INTEGER PRIMARY KEY, ip_addr_from INTEGER NOT NULL, ip_addr_to INTEGER NOT NULL, code INTEGER NOT NULL, options BLOB NOT NULL );"
+			"CREATE INDEX IF NOT EXISTS dhcp_options_range ON dhcp_options ( ip_addr_from, ip_addr_to, code );"
+			"CREATE TABLE IF NOT EXISTS dhcp_host ( ip_addr INTEGER PRIMARY KEY, mac_addr BLOB NOT NULL );"
+			"CREATE INDEX IF NOT EXISTS dhcp_host_mac ON dhcp_host ( mac_addr );"
+			"CREATE TABLE IF NOT EXISTS dhcp_pool ( id INTEGER PRIMARY KEY, ip_addr_from INTEGER NOT NULL, ip_addr_to INTEGER NOT NULL );"
+			"CREATE TABLE IF NOT EXISTS dhcp_exclusion ( id INTEGER PRIMARY KEY, ip_addr_from INTEGER NOT NULL, ip_addr_to INTEGER NOT NULL );"
+			"CREATE TABLE IF NOT EXISTS dhcp_version ( tables INTEGER NOT NULL );"
+			"INSERT INTO dhcp_version SELECT 0 WHERE NOT EXISTS ( SELECT 1 FROM dhcp_version );"
+			"CREATE TABLE IF NOT EXISTS dhcp_lease_change ( id INTEGER PRIMARY KEY AUTOINCREMENT, ip_addr INTEGER NOT NULL );" );
+
+		// Count the changes to everything but the leases, so the server
+		// knows when to reload its pools
+		for ( const char *table: { "dhcp_options", "dhcp_host", "dhcp_pool", "dhcp_exclusion" } )
+		{
+			for ( const char *event: { "insert", "update", "delete" } )
+			{
+				std::string sql = format( "CREATE TRIGGER IF NOT EXISTS {0}_{1} AFTER {1} ON {0} BEGIN UPDATE dhcp_version SET tables = tables + 1; END", table, event );
+				db.exec( sql.c_str() );
+			}
+		}
+
+		// Log the addresses of the changed leases, so the server sees the
+		// leases changed by the commands
+		db.exec(
+			"CREATE TRIGGER IF NOT EXISTS dhcp_lease_insert AFTER INSERT ON dhcp_lease BEGIN INSERT INTO dhcp_lease_change ( ip_addr ) VALUES ( NEW.ip_addr ); END;"
+			"CREATE TRIGGER IF NOT EXISTS dhcp_lease_update AFTER UPDATE ON dhcp_lease BEGIN INSERT INTO dhcp_lease_change ( ip_addr ) VALUES ( NEW.ip_addr ); END;"
+			"CREATE TRIGGER IF NOT EXISTS dhcp_lease_delete AFTER DELETE ON dhcp_lease BEGIN INSERT INTO dhcp_lease_change ( ip_addr ) VALUES ( OLD.ip_addr ); END;" );
+
+		std::string version = format( "INSERT INTO dhcp_schema SELECT {0} WHERE NOT EXISTS ( SELECT 1 FROM dhcp_schema )", schema_version );
+		db.exec( version.c_str() );
+	}
+
+	thread_local std::unique_ptr<sqlite_db> thread_db;
+
+	// The connection of the thread (opened when first used).
+	sqlite_db &connection( void )
+	{
+		static std::once_flag created;
+		if ( !thread_db )
+		{
+			thread_db.reset( new sqlite_db( databaseFile() ) );
+			std::call_once( created, [&]() { createSchema( *thread_db ); } );
+		}
+		return *thread_db;
+	}
+
+	// Lease writes, for the writer thread.
+	struct lease_intent
+	{
+		enum { ACQUIRE, RELEASE, EXPIRE } kind;
+		uint32_t ip;
+		uint8_t mac[6];
+		bool any_mac;
+		time_t expires;
+		bool result;
+		bool done;
+	};
+
+	std::mutex intent_mutex;
+	std::condition_variable intent_condition;
+	std::condition_variable intent_done;
+	std::vector<lease_intent*> intents;
+
+	// Write the batch in one transaction.
+	void commitIntents( sqlite_db &db, std::vector<lease_intent*> &batch )
+	{
+		for ( lease_intent *i: batch )
+			i->result = false;
+
+		db.exec( "BEGIN IMMEDIATE" );
+		auto rollback = make_guard( [&]() { sqlite3_exec( db, "ROLLBACK", NULL, NULL, NULL ); } );
+
+		time_t now = time( NULL );
+		std::vector<bool> results;
+		for ( lease_intent *i: batch )
+		{
+			switch ( i->kind )
+			{
+				case lease_intent::ACQUIRE:
+				{
+					// Only take over a lease of the same client, or one that has expired
+					query q( db,
+						"INSERT INTO dhcp_lease ( ip_addr, mac_addr, expiration ) VALUES ( ?, ?, ? ) "
+						"ON CONFLICT ( ip_addr ) DO UPDATE SET mac_addr = excluded.mac_addr, expiration = excluded.expiration "
+						"WHERE dhcp_lease.mac_addr = excluded.mac_addr OR dhcp_lease.expiration <= ?" );
+					q.bind( 0, ntohl( i->ip ) );
+					q.bind( 1, i->mac, 6 );
+					q.bind( 2, uint32_t( i->expires ) );
+					q.bind( 3, uint32_t( now ) );
+					q.step();
+					results.push_back( q.affected() > 0 );
+					break;
+				}
+
+				case lease_intent::RELEASE:
+				{
+					if ( i->any_mac )
+					{
+						query q( db, "DELETE FROM dhcp_lease WHERE ip_addr = ?" );
+						q.bind( 0, ntohl( i->ip ) );
+						q.step();
+						results.push_back( q.affected() > 0 );
+					}
+					else
+					{
+						query q( db, "DELETE FROM dhcp_lease WHERE ip_addr = ? AND mac_addr = ?" );
+						q.bind( 0, ntohl( i->ip ) );
+						q.bind( 1, i->mac, 6 );
+						q.step();
+						results.push_back( q.affected() > 0 );
+					}
+					break;
+				}
+
+				case lease_intent::EXPIRE:
+				{
+					query q( db, "DELETE FROM dhcp_lease WHERE ip_addr = ? AND expiration <= ?" );
+					q.bind( 0, ntohl( i->ip ) );
+					q.bind( 1, uint32_t( now ) );
+					q.step();
+					results.push_back( q.affected() > 0 );
+					break;
+				}
+			}
+		}
+
+		db.exec( "COMMIT" );
+		rollback.commit();
+
+		for ( size_t n = 0; n < batch.size(); ++n )
+			batch[n]->result = results[n];
+		commits.add();
+		commit_rows.add( batch.size() );
+	}
+
+	// Take the queued intents and write them, a batch at a time.
+	void leaseWriter( void )
+	{
+		std::unique_ptr<sqlite_db> db;
+		while ( 1 )
+		{
+			std::vector<lease_intent*> batch;
+			{
+				std::unique_lock<std::mutex> lock( intent_mutex );
+				while ( intents.empty() )
+					intent_condition.wait( lock );
+				batch.swap( intents );
+			}
+
+			try
+			{
+				if ( !db )
+					db.reset( new sqlite_db( databaseFile() ) );
+				commitIntents( *db, batch );
+			}
+			catch ( std::exception &e )
+			{
+				logMessage( LOG_ERR, LOGT_ERROR, "Lease commit: %s", e.what() );
+				for ( lease_intent *i: batch )
+					i->result = false;
+			}
+
+			std::unique_lock<std::mutex> lock( intent_mutex );
+			for ( lease_intent *i: batch )
+				i->done = true;
+			intent_done.notify_all();
+		}
+	}
+
+	// Queue the intents for the writer and wait for them to be written.
+	void submit( const std::vector<lease_intent*> &batch )
+	{
+		static std::once_flag started;
+		std::call_once( started, []() { std::thread( &leaseWriter ).detach(); } );
+
+		std::unique_lock<std::mutex> lock( intent_mutex );
+		for ( lease_intent *i: batch )
+		{
+			i->done = false;
+			intents.push_back( i );
+		}
+		intent_condition.notify_one();
+
+		for ( lease_intent *i: batch )
+		{
+			while ( !i->done )
+				intent_done.wait( lock );
+		}
+	}
+
+	// Read the pools and exclusions (network order).
+	void readPools( sqlite_db &db, std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions )
+	{
+		{
+			query q( db, "SELECT ip_addr_from, ip_addr_to FROM dhcp_pool ORDER BY ip_addr_from" );
+			while ( q.step() )
+				pools.emplace_back( htonl( q.number( 0 ) ), htonl( q.number( 1 ) ) );
+		}
+
+		query q( db, "SELECT ip_addr_from, ip_addr_to FROM dhcp_exclusion ORDER BY ip_addr_from" );
+		while ( q.step() )
+			exclusions.emplace_back( htonl( q.number( 0 ) ), htonl( q.number( 1 ) ) );
+	}
+
+	// The count of changes to the hosts, options and pools.
+	uint32_t tablesVersion( sqlite_db &db )
+	{
+		query q( db, "SELECT tables FROM dhcp_version" );
+		return q.step() ? q.number( 0 ) : 0;
+	}
+
+	// The last change to the leases.
+	int64_t lastLeaseChange( sqlite_db &db )
+	{
+		query q( db, "SELECT COALESCE( MAX( id ), 0 ) FROM dhcp_lease_change" );
+		return q.step() ? q.number64( 0 ) : 0;
+	}
+
+	// Bring the leases in memory up to date with the leases changed after
+	// the given change (by the server, or by the commands), and drop the
+	// changes read.  Returns the last change.
+	int64_t readLeaseChanges( sqlite_db &db, int64_t last )
+	{
+		time_t now = time( NULL );
+		int64_t first = last;
+		{
+			query q( db,
+				"SELECT c.id, c.ip_addr, l.mac_addr, l.expiration FROM dhcp_lease_change c "
+					"LEFT JOIN dhcp_lease l ON l.ip_addr = c.ip_addr "
+					"WHERE c.id > ? ORDER BY c.id LIMIT 10000" );
+			q.bind( 0, last );
+			while ( q.step() )
+			{
+				last = q.number64( 0 );
+				uint32_t ip = htonl( q.number( 1 ) );
+				std::string mac = q.text( 2 );
+				if ( !q.null( 2 ) && mac.size() == 6 && time_t( q.number( 3 ) ) > now )
+					rememberLease( ip, reinterpret_cast<const uint8_t *>( mac.data() ), q.number( 3 ) );
+				else
+					forgetLease( ip );
+			}
+		}
+
+		if ( last != first )
+		{
+			query q( db, "DELETE FROM dhcp_lease_change WHERE id <= ?" );
+			q.bind( 0, last );
+			q.step();
+		}
+		return last;
+	}
+
+	int64_t loaded_lease_change = 0;
+
+	// Build the dynamic pools and the client filter from the tables.
+	void loadTables( sqlite_db &db )
+	{
+		std::vector< std::pair<uint32_t, uint32_t> > pools, exclusions;
+		readPools( db, pools, exclusions );
+
+		std::vector<address_range> ranges, holes;
+		for ( auto &p: pools )
+			ranges.push_back( { ntohl( p.first ), ntohl( p.second ) } );
+		for ( auto &e: exclusions )
+			holes.push_back( { ntohl( e.first ), ntohl( e.second ) } );
+
+		std::vector<uint64_t> macs;
+		query q( db, "SELECT ip_addr, mac_addr FROM dhcp_host" );
+		while ( q.step() )
+		{
+			std::string mac = q.text( 1 );
+			if ( mac.size() != 6 )
+				continue;
+
+			uint32_t ip = q.number( 0 );
+			uint64_t m = pack_mac( reinterpret_cast<const uint8_t *>( mac.data() ) );
+			if ( m == 0 )
+				ranges.push_back( { ip, ip } );
+			else
+			{
+				holes.push_back( { ip, ip } );
+				macs.push_back( m );
+			}
+		}
+
+		std::vector<address_range> dynamic = subtractRanges( mergeRanges( ranges ), mergeRanges( holes ) );
+		buildPools( dynamic );
+		loadClientFilter( macs, !dynamic.empty() );
+		invalidateOptionCache();
+	}
+
+	// Expire the leases and offers every second, delete the expired rows
+	// (at most rate a second), reload the pools when the tables change, and
+	// follow the changes to the leases.
+	void leaseSweeper( int rate, uint32_t version, int64_t change )
+	{
+		std::deque<uint32_t> backlog;
+		while ( 1 )
+		{
+			std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
+
+			expireOffers();
+
+			std::vector<uint32_t> expired;
+			expireLeases( time( NULL ), expired );
+			if ( rate > 0 )
+				backlog.insert( backlog.end(), expired.begin(), expired.end() );
+
+			size_t n = std::min<size_t>( backlog.size(), rate );
+			if ( n > 0 )
+			{
+				std::vector<lease_intent> deletes( n );
+				std::vector<lease_intent*> batch;
+				for ( size_t i = 0; i < n; ++i )
+				{
+					deletes[i].kind = lease_intent::EXPIRE;
+					deletes[i].ip = backlog[i];
+					batch.push_back( &deletes[i] );
+				}
+				submit( batch );
+				backlog.erase( backlog.begin(), backlog.begin() + n );
+
+				for ( lease_intent &d: deletes )
+					sweep_deleted.add( d.result ? 1 : 0 );
+			}
+			sweep_backlog.set( backlog.size() );
+
+			try
+			{
+				sqlite_db &db = connection();
+				uint32_t v = tablesVersion( db );
+				if ( v != version )
+				{
+					loadTables( db );
+					version = v;
+				}
+				change = readLeaseChanges( db, change );
+			}
+			catch ( std::exception &e )
+			{
+				logMessage( LOG_ERR, LOGT_ERROR, "Reloading tables: %s", e.what() );
+			}
+		}
+	}
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::threadStop( void )
+{
+	thread_db.reset();
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::startSnapshot( void )
+{
+	sqlite_db &db = connection();
+	loadTables( db );
+
+	// Load the leases (dropping the ones that expired while stopped)
+	time_t now = time( NULL );
+	{
+		query q( db, "DELETE FROM dhcp_lease WHERE expiration <= ?" );
+		q.bind( 0, uint32_t( now ) );
+		q.step();
+	}
+
+	// The leases changed from here on are read by the sweeper
+	loaded_lease_change = lastLeaseChange( db );
+
+	size_t count = 0;
+	query q( db, "SELECT ip_addr, mac_addr, expiration FROM dhcp_lease" );
+	while ( q.step() )
+	{
+		std::string mac = q.text( 1 );
+		if ( mac.size() == 6 )
+		{
+			rememberLease( htonl( q.number( 0 ) ), reinterpret_cast<const uint8_t *>( mac.data() ), q.number( 2 ) );
+			++count;
+		}
+	}
+	syslog( LOG_INFO, "Loaded %zu leases", count );
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::startLeaseSweeper( void )
+{
+	int rate = config_int( "lease_sweep_rate", 100 );
+	uint32_t version = tablesVersion( connection() );
+	std::thread( std::bind( &leaseSweeper, std::max( 0, rate ), version, loaded_lease_change ) ).detach();
+}
+
+////////////////////////////////////////
+
+int sqlite_backend::schemaVersion( void )
+{
+	query q( connection(), "SELECT version FROM dhcp_schema" );
+	return q.step() ? int( q.number( 0 ) ) : 1;
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::migrateSchema( void )
+{
+	// The tables are created as needed, so only the version is behind
+	sqlite_db &db = connection();
+	createSchema( db );
+
+	std::string version = format( "UPDATE dhcp_schema SET version = {0}", schema_version );
+	db.exec( version.c_str() );
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::getAllLeases( std::vector< std::tuple<uint32_t, std::string, std::string> > &leases )
+{
+	query q( connection(), "SELECT ip_addr, mac_addr, strftime( '%Y-%m-%dT%H:%M:%S', expiration, 'unixepoch', 'localtime' ) FROM dhcp_lease ORDER BY ip_addr" );
+	while ( q.step() )
+		leases.emplace_back( htonl( q.number( 0 ) ), q.text( 1 ), q.text( 2 ) );
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::getAllHosts( std::vector< std::pair<uint32_t, std::string> > &hosts )
+{
+	query q( connection(), "SELECT ip_addr, mac_addr FROM dhcp_host ORDER BY ip_addr" );
+	while ( q.step() )
+		hosts.emplace_back( htonl( q.number( 0 ) ), q.text( 1 ) );
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::getAllOptions( std::vector< std::tuple<uint32_t, uint32_t, std::string> > &options )
+{
+	query q( connection(), "SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options ORDER BY ip_addr_from, ip_addr_to, options" );
+	while ( q.step() )
+		options.emplace_back( htonl( q.number( 0 ) ), htonl( q.number( 1 ) ), q.text( 2 ) );
+}
+
+////////////////////////////////////////
+
+std::vector<uint32_t> sqlite_backend::getIPAddresses( const uint8_t *hwaddr, bool avail )
+{
+	std::vector<uint32_t> ret;
+	if ( avail )
+	{
+		// The client's own addresses, then a few free dynamic ones
+		{
+			query q( connection(), "SELECT ip_addr FROM dhcp_host WHERE mac_addr = ? ORDER BY ip_addr" );
+			q.bind( 0, hwaddr, 6 );
+			while ( q.step() )
+			{
+				uint32_t ip = htonl( q.number( 0 ) );
+				if ( !leaseHeld( ip, hwaddr ) )
+					ret.push_back( ip );
+			}
+		}
+		freeAddresses( ret, free_candidates, hwaddr );
+	}
+	else
+	{
+		query q( connection(),
+			"SELECT ip_addr FROM dhcp_host "
+				"WHERE mac_addr = ? OR mac_addr = x'000000000000' "
+				"ORDER BY mac_addr DESC, ip_addr ASC" );
+		q.bind( 0, hwaddr, 6 );
+		while ( q.step() )
+			ret.push_back( htonl( q.number( 0 ) ) );
+	}
+
+	return ret;
+}
+
+////////////////////////////////////////
+
+std::vector<std::string> sqlite_backend::getMACAddresses( uint32_t ip )
+{
+	query q( connection(), "SELECT mac_addr FROM dhcp_host WHERE ip_addr = ?" );
+	q.bind( 0, ntohl( ip ) );
+
+	std::vector<std::string> ret;
+	while ( q.step() )
+		ret.push_back( q.text( 0 ) );
+	return ret;
+}
+
+////////////////////////////////////////
+
+bool sqlite_backend::addressAvailable( uint32_t ip, const uint8_t *hwaddr )
+{
+	{
+		query q( connection(), "SELECT 1 FROM dhcp_host WHERE ip_addr = ? AND mac_addr = ?" );
+		q.bind( 0, ntohl( ip ) );
+		q.bind( 1, hwaddr, 6 );
+		if ( q.step() )
+			return !leaseHeld( ip, hwaddr );
+	}
+
+	return poolAvailable( ip, hwaddr );
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::getOptions( uint32_t ip, std::vector<std::string> &options )
+{
+	query q( connection(), "SELECT ip_addr_from, ip_addr_to, options FROM dhcp_options WHERE ? BETWEEN ip_addr_from AND ip_addr_to" );
+	q.bind( 0, ntohl( ip ) );
+
+	// The smallest range wins, as with the other backends
+	std::vector<option_range> rows;
+	while ( q.step() )
+		rows.push_back( { q.number( 0 ), q.number( 1 ), q.text( 2 ) } );
+
+	std::vector<const option_range *> covering;
+	for ( const option_range &r: rows )
+		covering.push_back( &r );
+	mergeOptions( covering, options );
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::addHost( uint32_t ip, const uint8_t *mac )
+{
+	query q( connection(), "INSERT INTO dhcp_host ( ip_addr, mac_addr ) VALUES( ?, ? )" );
+	q.bind( 0, ntohl( ip ) );
+	q.bind( 1, mac, 6 );
+	q.step();
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::removeHost( uint32_t ip )
+{
+	query q( connection(), "DELETE FROM dhcp_host WHERE ip_addr = ?" );
+	q.bind( 0, ntohl( ip ) );
+	q.step();
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::addOption( uint32_t ip1, uint32_t ip2, const std::string &opt, bool replace )
+{
+	if ( replace )
+	{
+		// Replace the option with the same code
+		query q( connection(), "UPDATE dhcp_options SET options = ? WHERE ip_addr_from = ? AND ip_addr_to = ? AND code = ?" );
+		q.bind( 0, opt );
+		q.bind( 1, ntohl( ip1 ) );
+		q.bind( 2, ntohl( ip2 ) );
+		q.bind( 3, uint32_t( uint8_t( opt[0] ) ) );
+		q.step();
+	}
+	else
+	{
+		query q( connection(), "INSERT INTO dhcp_options ( ip_addr_from, ip_addr_to, code, options ) VALUES( ?, ?, ?, ? )" );
+		q.bind( 0, ntohl( ip1 ) );
+		q.bind( 1, ntohl( ip2 ) );
+		q.bind( 2, uint32_t( uint8_t( opt[0] ) ) );
+		q.bind( 3, opt );
+		q.step();
+	}
+
+	invalidateOptionCache();
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::removeOption( uint32_t ip1, uint32_t ip2, const std::string &opt )
+{
+	query q( connection(), "DELETE FROM dhcp_options WHERE ip_addr_from = ? AND ip_addr_to = ? AND options = ?" );
+	q.bind( 0, ntohl( ip1 ) );
+	q.bind( 1, ntohl( ip2 ) );
+	q.bind( 2, opt );
+	q.step();
+
+	invalidateOptionCache();
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::getAllPools( std::vector< std::pair<uint32_t, uint32_t> > &pools, std::vector< std::pair<uint32_t, uint32_t> > &exclusions )
+{
+	readPools( connection(), pools, exclusions );
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::addPool( uint32_t ip1, uint32_t ip2, bool exclusion )
+{
+	query q( connection(), exclusion ?
+		"INSERT INTO dhcp_exclusion ( ip_addr_from, ip_addr_to ) VALUES( ?, ? )" :
+		"INSERT INTO dhcp_pool ( ip_addr_from, ip_addr_to ) VALUES( ?, ? )" );
+	q.bind( 0, ntohl( ip1 ) );
+	q.bind( 1, ntohl( ip2 ) );
+	q.step();
+}
+
+////////////////////////////////////////
+
+void sqlite_backend::removePool( uint32_t ip1, uint32_t ip2, bool exclusion )
+{
+	query q( connection(), exclusion ?
+		"DELETE FROM dhcp_exclusion WHERE ip_addr_from = ? AND ip_addr_to = ?" :
+		"DELETE FROM dhcp_pool WHERE ip_addr_from = ? AND ip_addr_to = ?" );
+	q.bind( 0, ntohl( ip1 ) );
+	q.bind( 1, ntohl( ip2 ) );
+	q.step();
+}
+
+////////////////////////////////////////
+
+bool sqlite_backend::acquireLease( uint32_t ip, const uint8_t *hwaddr, uint32_t time )
+{
+	lease_intent i;
+	i.kind = lease_intent::ACQUIRE;
+	i.ip = ip;
+	memcpy( i.mac, hwaddr, 6 );
+	i.any_mac = false;
+	i.expires = ::time( NULL ) + time;
+	submit( std::vector<lease_intent*>( 1, &i ) );
+
+	if ( i.result )
+		rememberLease( ip, hwaddr, i.expires );
+	return i.result;
+}
+
+////////////////////////////////////////
+
+bool sqlite_backend::releaseLease( uint32_t ip, const uint8_t *hwaddr )
+{
+	lease_intent i;
+	i.kind = lease_intent::RELEASE;
+	i.ip = ip;
+	memset( i.mac, 0, 6 );
+	if ( hwaddr )
+		memcpy( i.mac, hwaddr, 6 );
+	i.any_mac = ( hwaddr == NULL );
+	i.expires = 0;
+	submit( std::vector<lease_intent*>( 1, &i ) );
+
+	if ( i.result )
+		forgetLease( ip );
+	return i.result;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,290 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "statement.h"
+#include "error.h"
+
+#include <string.h>
+
+namespace
+{
+	// Errors after which the statement has to be prepared again
+	bool lostStatement( unsigned int err )
+	{
+		return err == 2006 || err == 2013 || err == 1243;
+	}
+}
+
+////////////////////////////////////////
+
+statement::statement( MYSQL *db, const char *sql, const char *results )
+	: _db( db ), _sql( sql ), _results( results ), _stmt( NULL )
+{
+	prepare();
+
+	size_t n = mysql_stmt_param_count( _stmt );
+	_params.resize( n );
+	_param_numbers.resize( n );
+	_param_wide.resize( n );
+	_param_blobs.resize( n );
+	_param_lengths.resize( n );
+	memset( _params.data(), 0, n * sizeof(MYSQL_BIND) );
+
+	n = _results.size();
+	_columns.resize( n );
+	_numbers.resize( n );
+	_wide.resize( n );
+	_blobs.resize( n );
+	_lengths.resize( n );
+	_nulls.resize( n );
+	memset( _columns.data(), 0, n * sizeof(MYSQL_BIND) );
+	for ( size_t i = 0; i < n; ++i )
+	{
+		MYSQL_BIND &b = _columns[i];
+		if ( _results[i] == 'u' )
+		{
+			b.buffer_type = MYSQL_TYPE_LONG;
+			b.is_unsigned = 1;
+			b.buffer = &_numbers[i];
+			b.buffer_length = sizeof(uint32_t);
+		}
+		else if ( _results[i] == 'l' )
+		{
+			b.buffer_type = MYSQL_TYPE_LONGLONG;
+			b.is_unsigned = 1;
+			b.buffer = &_wide[i];
+			b.buffer_length = sizeof(uint64_t);
+		}
+		else
+		{
+			_blobs[i].resize( 64 );
+			b.buffer_type = MYSQL_TYPE_BLOB;
+			b.buffer = _blobs[i].data();
+			b.buffer_length = _blobs[i].size();
+		}
+		b.length = &_lengths[i];
+		b.is_null = &_nulls[i];
+	}
+}
+
+////////////////////////////////////////
+
+statement::~statement( void )
+{
+	close();
+}
+
+////////////////////////////////////////
+
+void statement::prepare( void )
+{
+	_stmt = mysql_stmt_init( _db );
+	if ( _stmt == NULL )
+		::error( "Unable to create mysql statement" );
+
+	if ( mysql_stmt_prepare( _stmt, _sql.c_str(), _sql.size() ) != 0 )
+	{
+		std::string msg = mysql_stmt_error( _stmt );
+		close();
+		::error( "Error preparing mysql statement: " + msg );
+	}
+}
+
+////////////////////////////////////////
+
+void statement::close( void )
+{
+	if ( _stmt )
+		mysql_stmt_close( _stmt );
+	_stmt = NULL;
+}
+
+////////////////////////////////////////
+
+void statement::bind( size_t i, uint32_t value )
+{
+	_param_numbers[i] = value;
+	MYSQL_BIND &b = _params[i];
+	b.buffer_type = MYSQL_TYPE_LONG;
+	b.is_unsigned = 1;
+	b.buffer = &_param_numbers[i];
+	b.buffer_length = sizeof(uint32_t);
+	b.length = NULL;
+}
+
+////////////////////////////////////////
+
+void statement::bind( size_t i, uint64_t value )
+{
+	_param_wide[i] = value;
+	MYSQL_BIND &b = _params[i];
+	b.buffer_type = MYSQL_TYPE_LONGLONG;
+	b.is_unsigned = 1;
+	b.buffer = &_param_wide[i];
+	b.buffer_length = sizeof(uint64_t);
+	b.length = NULL;
+}
+
+////////////////////////////////////////
+
+void statement::bind( size_t i, const void *data, size_t size )
+{
+	_param_blobs[i].assign( static_cast<const char *>( data ), size );
+	_param_lengths[i] = size;
+	MYSQL_BIND &b = _params[i];
+	b.buffer_type = MYSQL_TYPE_BLOB;
+	b.is_unsigned = 0;
+	b.buffer = &_param_blobs[i][0];
+	b.buffer_length = size;
+	b.length = &_param_lengths[i];
+}
+
+////////////////////////////////////////
+
+bool statement::execute( void )
+{
+	for ( int attempt = 0; attempt < 2; ++attempt )
+	{
+		if ( _stmt == NULL )
+		{
+			// Reconnect (if needed) and prepare again
+			mysql_ping( _db );
+			try
+			{
+				prepare();
+			}
+			catch ( ... )
+			{
+				return false;
+			}
+		}
+
+		mysql_stmt_free_result( _stmt );
+		if ( !_params.empty() && mysql_stmt_bind_param( _stmt, _params.data() ) != 0 )
+			return false;
+
+		if ( mysql_stmt_execute( _stmt ) != 0 )
+		{
+			if ( attempt == 0 && lostStatement( mysql_stmt_errno( _stmt ) ) )
+			{
+				close();
+				continue;
+			}
+			return false;
+		}
+
+		if ( !_columns.empty() )
+		{
+			if ( mysql_stmt_bind_result( _stmt, _columns.data() ) != 0 )
+				return false;
+			if ( mysql_stmt_store_result( _stmt ) != 0 )
+				return false;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+////////////////////////////////////////
+
+bool statement::fetch( void )
+{
+	int ret = mysql_stmt_fetch( _stmt );
+	if ( ret == MYSQL_DATA_TRUNCATED )
+	{
+		// Grow the buffers that were too small, and keep them for later rows
+		for ( size_t i = 0; i < _columns.size(); ++i )
+		{
+			MYSQL_BIND &b = _columns[i];
+			if ( _results[i] != 's' || _lengths[i] <= b.buffer_length )
+				continue;
+
+			_blobs[i].resize( _lengths[i] );
+			b.buffer = _blobs[i].data();
+			b.buffer_length = _blobs[i].size();
+			if ( mysql_stmt_fetch_column( _stmt, &b, i, 0 ) != 0 )
+				return false;
+		}
+		mysql_stmt_bind_result( _stmt, _columns.data() );
+		ret = 0;
+	}
+	return ret == 0;
+}
+
+////////////////////////////////////////
+
+uint32_t statement::number( size_t col ) const
+{
+	return _nulls[col] ? 0 : _numbers[col];
+}
+
+////////////////////////////////////////
+
+uint64_t statement::number64( size_t col ) const
+{
+	return _nulls[col] ? 0 : _wide[col];
+}
+
+////////////////////////////////////////
+
+std::string statement::text( size_t col ) const
+{
+	if ( _nulls[col] )
+		return std::string();
+	return std::string( _blobs[col].data(), _lengths[col] );
+}
+
+////////////////////////////////////////
+
+uint64_t statement::affected( void )
+{
+	return mysql_stmt_affected_rows( _stmt );
+}
+
+////////////////////////////////////////
+
+unsigned int statement::errnum( void )
+{
+	return _stmt ? mysql_stmt_errno( _stmt ) : mysql_errno( _db );
+}
+
+////////////////////////////////////////
+
+const char *statement::error( void )
+{
+	return _stmt ? mysql_stmt_error( _stmt ) : mysql_error( _db );
+}
+
+////////////////////////////////////////
+
+statement &statement_cache::prepared( const char *sql, const char *results )
+{
+	std::unique_ptr<statement> &s = _statements[sql];
+	if ( !s )
+		s.reset( new statement( _db, sql, results ) );
+	return *s;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <mysql/mysql.h>
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+////////////////////////////////////////
+
+// A prepared statement with binary parameters and results.
+// The result columns are described by a string with one character per
+// column: 'u' for an unsigned integer, 'l' for a 64-bit unsigned integer
+// and 's' for a string or blob.
+// Result buffers are kept and reused between executions.
+class statement
+{
+public:
+	statement( MYSQL *db, const char *sql, const char *results );
+	~statement( void );
+
+	// Set parameters (counting from 0) for the next execute.
+	void bind( size_t i, uint32_t value );
+	void bind( size_t i, uint64_t value );
+	void bind( size_t i, const void *data, size_t size );
+	void bind( size_t i, const std::string &value )
+	{
+		bind( i, value.data(), value.size() );
+	}
+
+	// Run the statement, storing the results.
+	// Returns false on error.
+	bool execute( void );
+
+	// Get the next row of the results.
+	bool fetch( void );
+
+	// Get a column of the current row.
+	uint32_t number( size_t col ) const;
+	uint64_t number64( size_t col ) const;
+	std::string text( size_t col ) const;
+
+	uint64_t affected( void );
+	unsigned int errnum( void );
+	const char *error( void );
+
+private:
+	void prepare( void );
+	void close( void );
+
+	MYSQL *_db;
+	std::string _sql;
+	std::string _results;
+	MYSQL_STMT *_stmt;
+
+	std::vector<MYSQL_BIND> _params;
+	std::vector<uint32_t> _param_numbers;
+	std::vector<uint64_t> _param_wide;
+	std::vector<std::string> _param_blobs;
+	std::vector<unsigned long> _param_lengths;
+
+	std::vector<MYSQL_BIND> _columns;
+	std::vector<uint32_t> _numbers;
+	std::vector<uint64_t> _wide;
+	std::vector< std::vector<char> > _blobs;
+	std::vector<unsigned long> _lengths;
+	std::vector<my_bool> _nulls;
+};
+
+////////////////////////////////////////
+
+// The statements prepared on a connection, owned by the connection (so
+// no lock is needed to find them).  They are closed with the cache.
+class statement_cache
+{
+public:
+	explicit statement_cache( MYSQL *db )
+		: _db( db )
+	{
+	}
+
+	// Get the statement, preparing it the first time.
+	// The sql must be a string literal (the pointer identifies the statement).
+	statement &prepared( const char *sql, const char *results );
+
+private:
+	statement_cache( const statement_cache & ) = delete;
+	statement_cache &operator=( const statement_cache & ) = delete;
+
+	MYSQL *_db;
+	std::map< const char *, std::unique_ptr<statement> > _statements;
+};
+
+// Get the statement prepared on the connection, preparing it the first time.
+inline statement &prepared( statement_cache &cache, const char *sql, const char *results = "" )
+{
+	return cache.prepared( sql, results );
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,78 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#include "stats.h"
+
+#include <syslog.h>
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace
+{
+	std::mutex &statsMutex( void )
+	{
+		static std::mutex m;
+		return m;
+	}
+
+	std::vector<stat_counter*> &allStats( void )
+	{
+		static std::vector<stat_counter*> stats;
+		return stats;
+	}
+}
+
+////////////////////////////////////////
+
+stat_counter::stat_counter( const char *name )
+	: _name( name ), _value( 0 )
+{
+	std::unique_lock<std::mutex> lock( statsMutex() );
+	allStats().push_back( this );
+}
+
+////////////////////////////////////////
+
+void reportStats( void )
+{
+	std::string line;
+	{
+		std::unique_lock<std::mutex> lock( statsMutex() );
+		for ( stat_counter *s: allStats() )
+		{
+			if ( !line.empty() )
+				line.append( " " );
+			line.append( s->name() );
+			line.push_back( '=' );
+			line.append( std::to_string( s->value() ) );
+		}
+	}
+
+	if ( !line.empty() )
+		syslog( LOG_INFO, "Stats: %s", line.c_str() );
+}
+
+////////////////////////////////////////
+
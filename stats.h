@@ -0,0 +1,55 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+////////////////////////////////////////
+
+// A named counter, reported to syslog by reportStats.
+// Counters must have static storage duration.
+class stat_counter
+{
+public:
+	explicit stat_counter( const char *name );
+
+	void add( uint64_t n = 1 ) { _value.fetch_add( n, std::memory_order_relaxed ); }
+	void set( uint64_t n ) { _value.store( n, std::memory_order_relaxed ); }
+	uint64_t value( void ) const { return _value.load( std::memory_order_relaxed ); }
+
+	const char *name( void ) const { return _name; }
+
+private:
+	const char *_name;
+	std::atomic<uint64_t> _value;
+};
+
+////////////////////////////////////////
+
+// Log the current value of all counters.
+void reportStats( void );
+
+////////////////////////////////////////
+
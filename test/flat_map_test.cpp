@@ -0,0 +1,101 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+// Check flat_map against std::unordered_map over random inserts, erases
+// and lookups (a small key range, so keys are reused and tombstones pile
+// up), and then compare the entries with for_each.
+
+#include "flat_map.h"
+
+#include <iostream>
+#include <random>
+#include <unordered_map>
+
+int main( void )
+{
+	const size_t operations = 2000000;
+
+	flat_map<uint64_t, uint32_t> fm;
+	std::unordered_map<uint64_t, uint32_t> um;
+
+	std::mt19937_64 random( 7 );
+	for ( size_t i = 0; i < operations; ++i )
+	{
+		uint64_t key = random() % 50000;
+		switch ( random() % 4 )
+		{
+			case 0:
+			case 1:
+				fm[key] = uint32_t( i );
+				um[key] = uint32_t( i );
+				break;
+
+			case 2:
+				if ( fm.erase( key ) != ( um.erase( key ) > 0 ) )
+				{
+					std::cerr << "erase " << key << " differs at " << i << std::endl;
+					return 1;
+				}
+				break;
+
+			case 3:
+			{
+				const uint32_t *v = fm.find( key );
+				auto u = um.find( key );
+				if ( ( v == NULL ) != ( u == um.end() ) || ( v && *v != u->second ) )
+				{
+					std::cerr << "find " << key << " differs at " << i << std::endl;
+					return 1;
+				}
+				break;
+			}
+		}
+
+		if ( fm.size() != um.size() )
+		{
+			std::cerr << "size differs at " << i << std::endl;
+			return 1;
+		}
+	}
+
+	size_t count = 0;
+	bool same = true;
+	fm.for_each( [&]( uint64_t key, uint32_t value )
+	{
+		auto u = um.find( key );
+		same = same && u != um.end() && u->second == value;
+		++count;
+	} );
+	if ( !same || count != um.size() )
+	{
+		std::cerr << "entries differ" << std::endl;
+		return 1;
+	}
+
+	std::cout << operations << " operations, " << count << " entries: same" << std::endl;
+	return 0;
+}
+
+////////////////////////////////////////
+
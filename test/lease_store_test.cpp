@@ -0,0 +1,224 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+// Check that the lease store's redo log brings back every acknowledged
+// lease after a crash.  A child process acquires leases, telling the
+// parent of each one, and copies the store file after each checkpoint.
+// The last leases are acquired after the last copy, then the child is
+// killed and its store file replaced by the copy, losing the record
+// writes the page cache would otherwise keep.  Opening the store must
+// replay the log over the copy and give back every lease.  The log is
+// smaller than the number of leases, so it wraps across checkpoints.
+// Also checks that a second open of the store fails while the child
+// has it.
+
+#include "lease_store.h"
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	const std::string store_file = "lease_store_test.store";
+	const std::string copy_file = store_file + ".copy";
+	const uint32_t network = 0x0A010000;
+
+	const size_t log_size = 4096;
+	const uint32_t checkpoint_every = 1000;
+	const uint32_t checkpointed_leases = 12000;
+	const uint32_t logged_leases = 2000;
+
+	// Sent to the parent after each copy of the store
+	const uint32_t copied = 0xFFFFFFFF;
+
+	void removeStore( void )
+	{
+		remove( store_file.c_str() );
+		remove( ( store_file + ".log" ).c_str() );
+		remove( copy_file.c_str() );
+	}
+
+	void clientMAC( uint32_t i, uint8_t *mac )
+	{
+		uint8_t m[6] = { 0x02, 0x00, 0x00, 0x00, uint8_t( i >> 8 ), uint8_t( i ) };
+		std::copy( m, m + 6, mac );
+	}
+
+	void copyStore( void )
+	{
+		std::string tmp = copy_file + ".tmp";
+		{
+			std::ifstream in( store_file, std::ios::binary );
+			std::ofstream out( tmp, std::ios::binary );
+			out << in.rdbuf();
+		}
+		rename( tmp.c_str(), copy_file.c_str() );
+	}
+
+	void tell( int fd, uint32_t v )
+	{
+		if ( write( fd, &v, sizeof(v) ) != sizeof(v) )
+			_exit( 1 );
+	}
+
+	// Acquire a lease for each address in turn, writing the number of
+	// each one acquired to fd.  Waits to be killed when done.
+	void writer( int fd )
+	{
+		lease_store store( store_file, htonl( network ), 16, log_size );
+		for ( uint32_t i = 0; i < checkpointed_leases + logged_leases; ++i )
+		{
+			if ( i % checkpoint_every == 0 && i <= checkpointed_leases )
+			{
+				store.checkpoint();
+				copyStore();
+				tell( fd, copied );
+			}
+
+			uint8_t mac[6];
+			clientMAC( i, mac );
+			time_t expires;
+			if ( store.acquire( htonl( network + i ), mac, 3600, expires ) )
+				tell( fd, i );
+		}
+		while ( 1 )
+			pause();
+	}
+
+	// Read from fd until the value is v (or the end).
+	bool readUntil( int fd, uint32_t v, std::vector<uint32_t> &acked, size_t &after_copy )
+	{
+		uint32_t i;
+		while ( read( fd, &i, sizeof(i) ) == sizeof(i) )
+		{
+			if ( i == copied )
+				after_copy = 0;
+			else
+			{
+				acked.push_back( i );
+				++after_copy;
+			}
+			if ( i == v )
+				return true;
+		}
+		return false;
+	}
+}
+
+////////////////////////////////////////
+
+int main( void )
+{
+	removeStore();
+
+	int fds[2];
+	if ( pipe( fds ) != 0 )
+	{
+		std::cerr << "pipe failed" << std::endl;
+		return 1;
+	}
+
+	pid_t pid = fork();
+	if ( pid == 0 )
+	{
+		close( fds[0] );
+		try
+		{
+			writer( fds[1] );
+		}
+		catch ( std::exception &e )
+		{
+			std::cerr << "writer: " << e.what() << std::endl;
+		}
+		_exit( 1 );
+	}
+	close( fds[1] );
+
+	// Wait for the first lease, then check the store can't be opened twice
+	std::vector<uint32_t> acked;
+	size_t after_copy = 0;
+	bool ok = readUntil( fds[0], 0, acked, after_copy );
+	if ( ok )
+	{
+		try
+		{
+			lease_store second( store_file, htonl( network ), 16, log_size );
+			std::cerr << "store opened by two processes" << std::endl;
+			ok = false;
+		}
+		catch ( std::exception &e )
+		{
+		}
+	}
+
+	// Wait for the last lease, and crash
+	ok = ok && readUntil( fds[0], checkpointed_leases + logged_leases - 1, acked, after_copy );
+	kill( pid, SIGKILL );
+	waitpid( pid, NULL, 0 );
+	if ( !ok )
+	{
+		std::cerr << "writer failed" << std::endl;
+		removeStore();
+		return 1;
+	}
+
+	// Lose the record writes since the last copy
+	if ( rename( copy_file.c_str(), store_file.c_str() ) != 0 )
+	{
+		std::cerr << "no copy of the store" << std::endl;
+		removeStore();
+		return 1;
+	}
+
+	size_t missing = 0;
+	size_t recovered = 0;
+	{
+		lease_store store( store_file, htonl( network ), 16, log_size );
+		recovered = store.size();
+		for ( uint32_t a: acked )
+		{
+			uint8_t mac[6];
+			clientMAC( a, mac );
+			if ( store.leased( mac ) != htonl( network + a ) )
+				++missing;
+		}
+	}
+	removeStore();
+
+	std::cout << "acknowledged " << acked.size() << " (" << after_copy << " only in the log), recovered "
+		<< recovered << ", missing " << missing << std::endl;
+	return ( missing == 0 && after_copy == logged_leases && acked.size() == checkpointed_leases + logged_leases ) ? 0 : 1;
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,90 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+////////////////////////////////////////
+
+timer_wheel::timer_wheel( time_t now )
+	: _now( now ), _size( 0 )
+{
+}
+
+////////////////////////////////////////
+
+void timer_wheel::schedule( uint64_t key, time_t when )
+{
+	place( timer { key, when }, _now + 1 );
+	++_size;
+}
+
+////////////////////////////////////////
+
+void timer_wheel::advance( time_t now, std::vector<uint64_t> &due )
+{
+	while ( _now < now )
+	{
+		++_now;
+
+		// Move the timers of the slots starting now down a level,
+		// from the top, so each level is refilled before it turns
+		for ( int l = levels - 1; l > 0; --l )
+		{
+			if ( ( _now & ( ( time_t( 1 ) << ( bits * l ) ) - 1 ) ) != 0 )
+				continue;
+
+			std::vector<timer> moving;
+			moving.swap( _wheel[l][( _now >> ( bits * l ) ) & ( slots - 1 )] );
+			for ( const timer &t: moving )
+				place( t, _now );
+		}
+
+		std::vector<timer> &slot = _wheel[0][_now & ( slots - 1 )];
+		for ( const timer &t: slot )
+			due.push_back( t.key );
+		_size -= slot.size();
+		slot.clear();
+	}
+}
+
+////////////////////////////////////////
+
+void timer_wheel::place( const timer &t, time_t earliest )
+{
+	// Past timers go in the earliest slot still to come, and ones beyond
+	// the last level wait as far out as it reaches
+	time_t when = std::max( t.when, earliest );
+	when = std::min( when, _now + ( time_t( 1 ) << ( bits * levels ) ) - 1 );
+
+	time_t delta = when - _now;
+	int l = 0;
+	while ( delta >= ( time_t( 1 ) << ( bits * ( l + 1 ) ) ) )
+		++l;
+	_wheel[l][( when >> ( bits * l ) ) & ( slots - 1 )].push_back( t );
+}
+
+////////////////////////////////////////
+
@@ -0,0 +1,72 @@
+//
+// Copyright (c) 2013 Ian Godin
+//
+// Permission is hereby granted, free of charge, to any person obtaining
+// a copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included
+// in all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+// EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+// MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+// CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+// TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE
+// OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+
+
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+////////////////////////////////////////
+
+// A hierarchical timer wheel with a resolution of one second.  Four
+// levels of 64 slots cover about 194 days; later timers wait in the last
+// level and are placed again as it turns.
+// Timers are not cancelled: the owner checks each key it gets back and
+// ignores the ones that were renewed or removed since.
+class timer_wheel
+{
+public:
+	explicit timer_wheel( time_t now );
+
+	// Add a timer for the key, due at when.
+	void schedule( uint64_t key, time_t when );
+
+	// Append the keys of the timers due at or before now.
+	void advance( time_t now, std::vector<uint64_t> &due );
+
+	size_t size( void ) const
+	{
+		return _size;
+	}
+
+private:
+	struct timer
+	{
+		uint64_t key;
+		time_t when;
+	};
+
+	static const int levels = 4;
+	static const int bits = 6;
+	static const int slots = 1 << bits;
+
+	void place( const timer &t, time_t earliest );
+
+	std::vector<timer> _wheel[levels][slots];
+	time_t _now;
+	size_t _size;
+};
+
+////////////////////////////////////////
+